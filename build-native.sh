@@ -0,0 +1,13 @@
+#!/bin/bash
+echo "Compiling native tools..."
+# Same engine sources as build.sh, built with the host compiler for benchmarks and servers.
+# -O3 -march=native: host SIMD (AVX2 etc.) instead of wasm SIMD128
+# -pthread: the threaded training modes
+mkdir -p bin
+FLAGS="-std=c++17 -O3 -march=native -pthread"
+ENGINE="cpp/matrix.cpp cpp/gemm.cpp cpp/nn.cpp cpp/checkpoint.cpp cpp/augment.cpp cpp/sparse.cpp cpp/trainer.cpp cpp/tensor.cpp cpp/cache.cpp cpp/modeljson.cpp cpp/online.cpp"
+g++ $FLAGS cpp/bench.cpp cpp/mnist.cpp $ENGINE -o bin/bench
+g++ $FLAGS cpp/server.cpp $ENGINE -o bin/server
+g++ $FLAGS cpp/ps.cpp cpp/mnist.cpp $ENGINE -o bin/ps
+g++ $FLAGS cpp/loadgen.cpp -o bin/loadgen
+echo "Done! Binaries saved to bin/"
@@ -4,5 +4,5 @@ echo "Compiling C++ to WebAssembly..."
 # -O3: Aggressive optimization for speed
 # -flto: Link Time Optimization
 # -msimd128: Enable SIMD instructions (great for matrix ops)
-emcc cpp/wasm.cpp cpp/matrix.cpp cpp/nn.cpp -lembind -o wasmJs/wasm.js -s MODULARIZE=1 -s EXPORT_NAME='createMathModule' -O3 -flto -msimd128
+emcc cpp/wasm.cpp cpp/matrix.cpp cpp/gemm.cpp cpp/nn.cpp cpp/checkpoint.cpp cpp/augment.cpp cpp/sparse.cpp cpp/trainer.cpp cpp/tensor.cpp cpp/cache.cpp cpp/modeljson.cpp cpp/online.cpp -lembind -o wasmJs/wasm.js -s MODULARIZE=1 -s EXPORT_NAME='createMathModule' -O3 -flto -msimd128
 echo "Done! Output saved to wasmJs/wasm.js"
@@ -0,0 +1,175 @@
+#include "augment.h"
+#include <algorithm>
+#include <cmath>
+
+// Images are sampled from a padded copy: one zero pixel on the top/left and two on the
+// bottom/right, so clamped coordinates always land on a zero and the bilinear
+// neighbour (x0 + 1, y0 + 1) never leaves the buffer.
+static const int PAD = 3;
+
+// Kept apart from the streams NeuralNetwork uses for initialization, so one seed can drive both.
+static const uint64_t AUGMENT_STREAM = 0xa0ull << 32;
+
+Augmenter::Augmenter(int width, int height, unsigned int seed, const AugmentConfig &config)
+    : width(width), height(height), rng(seed, AUGMENT_STREAM), config(config) {
+   size_t paddedSize = (size_t)(width + PAD) * (height + PAD);
+   padded.assign(paddedSize, 0.0);
+   stroke.assign(paddedSize, 0.0);
+   rowExtreme.assign(paddedSize, 0.0);
+   srcX.resize((size_t)width * height);
+   srcY.resize((size_t)width * height);
+   srcIndex.resize((size_t)width * height);
+
+   // Linear interpolation weights of each grid column for every x (and grid row for every y):
+   // the elastic field at (x, y) is then sum_g basisX[g][x] * (sum_h basisY[h][y] * grid[h][g]).
+   auto fillBasis = [](std::vector<double> &basis, int size) {
+      basis.assign((size_t)GRID * size, 0.0);
+      double scale = (double)(GRID - 1) / std::max(1, size - 1);
+      for (int i = 0; i < size; i++) {
+         double g = i * scale;
+         int g0 = std::min((int)g, GRID - 2);
+         double f = g - g0;
+         basis[(size_t)g0 * size + i] = 1 - f;
+         basis[(size_t)(g0 + 1) * size + i] = f;
+      }
+   };
+   fillBasis(basisX, width);
+   fillBasis(basisY, height);
+}
+
+// Max (dilate) or min (erode) over the 3x3 neighbourhood, done separably: a 3-wide pass
+// along each row into rowExtreme, then a 3-high pass down the columns.
+template <typename Pick>
+static void extreme3x3(const double *padded, double *rows, double *stroke, int width, int height, int pw, double a,
+                       Pick pick) {
+   for (int y = 0; y <= height + 1; y++) {
+      const double *in = padded + (size_t)y * pw;
+      double *out = rows + (size_t)y * pw;
+      for (int x = 1; x <= width; x++) {
+         out[x] = pick(in[x - 1], pick(in[x], in[x + 1]));
+      }
+   }
+   for (int y = 1; y <= height; y++) {
+      const double *up = rows + (size_t)(y - 1) * pw;
+      const double *mid = rows + (size_t)y * pw;
+      const double *down = rows + (size_t)(y + 1) * pw;
+      const double *orig = padded + (size_t)y * pw;
+      double *out = stroke + (size_t)y * pw;
+      for (int x = 1; x <= width; x++) {
+         double m = pick(up[x], pick(mid[x], down[x]));
+         out[x] = orig[x] + a * (m - orig[x]);
+      }
+   }
+}
+
+void Augmenter::thicken(double amount) {
+   // 3x3 grayscale dilation (amount > 0) or erosion (amount < 0), blended with the
+   // original by |amount| so fractional values give fractional stroke changes.
+   int pw = width + PAD;
+   double a = std::min(1.0, std::abs(amount));
+   if (amount > 0) {
+      extreme3x3(padded.data(), rowExtreme.data(), stroke.data(), width, height, pw, a,
+                 [](double p, double q) { return p > q ? p : q; });
+   } else {
+      extreme3x3(padded.data(), rowExtreme.data(), stroke.data(), width, height, pw, a,
+                 [](double p, double q) { return p < q ? p : q; });
+   }
+}
+
+void Augmenter::augment(const double *in, double *out) {
+   int pw = width + PAD;
+   for (int y = 0; y < height; y++) {
+      std::copy(in + (size_t)y * width, in + (size_t)(y + 1) * width, &padded[(size_t)(y + 1) * pw + 1]);
+   }
+
+   double angle = rng.uniform(-1.0, 1.0) * config.maxRotation;
+   double scale = 1.0 + rng.uniform(-1.0, 1.0) * config.maxScale;
+   double shear = rng.uniform(-1.0, 1.0) * config.maxShear;
+   double tx = rng.uniform(-1.0, 1.0) * config.maxShift;
+   double ty = rng.uniform(-1.0, 1.0) * config.maxShift;
+   double thickness = rng.uniform(config.minThickness, config.maxThickness);
+   double gridX[GRID * GRID], gridY[GRID * GRID];
+   for (int i = 0; i < GRID * GRID; i++) {
+      gridX[i] = rng.uniform(-1.0, 1.0) * config.elasticAlpha;
+      gridY[i] = rng.uniform(-1.0, 1.0) * config.elasticAlpha;
+   }
+
+   const double *src = padded.data();
+   if (thickness != 0.0) {
+      thicken(thickness);
+      src = stroke.data();
+   }
+
+   // Forward map M = R(angle) * [[scale, shear], [0, scale]] about the image centre;
+   // each output pixel pulls from M^-1 * (p - centre - shift) + centre.
+   double c = std::cos(angle), s = std::sin(angle);
+   double m00 = c * scale, m01 = c * shear - s * scale;
+   double m10 = s * scale, m11 = s * shear + c * scale;
+   double det = m00 * m11 - m01 * m10;
+   double i00 = m11 / det, i01 = -m01 / det;
+   double i10 = -m10 / det, i11 = m00 / det;
+   double cx = (width - 1) / 2.0, cy = (height - 1) / 2.0;
+
+   // Pass 1: source coordinates, affine plus the elastic field upsampled from the coarse grid.
+   // Each row first blends the grid rows, so the per-pixel work is GRID multiply-adds per axis.
+   for (int y = 0; y < height; y++) {
+      double v = y - cy - ty;
+      double rowX[GRID], rowY[GRID];
+      for (int g = 0; g < GRID; g++) {
+         rowX[g] = rowY[g] = 0;
+         for (int h = 0; h < GRID; h++) {
+            double w = basisY[(size_t)h * height + y];
+            rowX[g] += w * gridX[h * GRID + g];
+            rowY[g] += w * gridY[h * GRID + g];
+         }
+      }
+      double baseX = cx + i00 * (-cx - tx) + i01 * v;
+      double baseY = cy + i10 * (-cx - tx) + i11 * v;
+      double *sx = &srcX[(size_t)y * width];
+      double *sy = &srcY[(size_t)y * width];
+      for (int x = 0; x < width; x++) {
+         sx[x] = baseX + i00 * x;
+         sy[x] = baseY + i10 * x;
+      }
+      for (int g = 0; g < GRID; g++) {
+         const double *b = &basisX[(size_t)g * width];
+         double ex = rowX[g], ey = rowY[g];
+         for (int x = 0; x < width; x++) {
+            sx[x] += b[x] * ex;
+            sy[x] += b[x] * ey;
+         }
+      }
+   }
+
+   // Pass 2: clamp the coordinates (+1 for the padding) into the padded source and split them
+   // into the offset of the top-left neighbour and the bilinear fractions. Local copies of the
+   // sizes, and bounds just below width + 1 that the compiler cannot fold back into integers,
+   // keep this loop vectorizable; clamped pixels still sample only zero padding.
+   int n = width * height;
+   double maxX = std::nextafter(width + 1.0, 0.0), maxY = std::nextafter(height + 1.0, 0.0);
+   double *fracX = srcX.data(), *fracY = srcY.data();
+   int *index = srcIndex.data();
+   for (int i = 0; i < n; i++) {
+      double px = std::min(std::max(fracX[i] + 1.0, 0.0), maxX);
+      double py = std::min(std::max(fracY[i] + 1.0, 0.0), maxY);
+      int x0 = (int)px;
+      int y0 = (int)py;
+      fracX[i] = px - x0;
+      fracY[i] = py - y0;
+      index[i] = y0 * pw + x0;
+   }
+
+   // Pass 3: bilinear gather.
+   for (int i = 0; i < n; i++) {
+      double fx = fracX[i], fy = fracY[i];
+      const double *p = src + index[i];
+      out[i] = (1 - fy) * ((1 - fx) * p[0] + fx * p[1]) + fy * ((1 - fx) * p[pw] + fx * p[pw + 1]);
+   }
+}
+
+void Augmenter::augmentBatch(const double *in, double *out, int count) {
+   size_t size = (size_t)width * height;
+   for (int b = 0; b < count; b++) {
+      augment(in + b * size, out + b * size);
+   }
+}
@@ -0,0 +1,56 @@
+#ifndef AUGMENT_H
+#define AUGMENT_H
+
+#include "rng.h"
+#include <vector>
+
+// Ranges for the random distortions applied to each training image. Every value is
+// drawn uniformly from [-max, max] (thickness from [minThickness, maxThickness]).
+struct AugmentConfig {
+   double maxShift = 3.0;       // Pixels
+   double maxRotation = 0.26;   // Radians (about 15 degrees)
+   double maxScale = 0.15;      // Relative zoom
+   double maxShear = 0.2;
+   double elasticAlpha = 1.5;   // Peak elastic displacement in pixels, 0 disables
+   double minThickness = -0.3;  // < 0 erodes the stroke (thinner)
+   double maxThickness = 1.0;   // > 0 dilates the stroke (thicker, like canvas drawings)
+};
+
+// Random shift / rotation / scale / shear, elastic distortion and stroke thickness
+// changes for square grayscale images, resampled bilinearly. The per-pixel work is
+// laid out as straight-line loops over flat arrays so the compiler can vectorize them.
+class Augmenter {
+private:
+   static const int GRID = 4; // Elastic displacement control points per side
+
+   int width;
+   int height;
+   RngStream rng; // Counter-based, so a seed reproduces the same distortions on every platform
+
+   // Scratch for one image, kept between calls
+   std::vector<double> padded; // Input with a one pixel zero border
+   std::vector<double> stroke; // Dilated or eroded copy of padded
+   std::vector<double> rowExtreme; // Row pass of the 3x3 dilation/erosion
+   std::vector<double> basisX; // GRID x width elastic interpolation weights
+   std::vector<double> basisY; // GRID x height
+   std::vector<double> srcX;
+   std::vector<double> srcY;
+   std::vector<int> srcIndex; // Padded offset of each output pixel's top-left source neighbour
+
+   void thicken(double amount);
+
+public:
+   AugmentConfig config;
+
+   Augmenter(int width, int height, unsigned int seed, const AugmentConfig &config = AugmentConfig());
+
+   // Distorts one width * height image from in into out (they must not overlap).
+   void augment(const double *in, double *out);
+   void augmentBatch(const double *in, double *out, int count);
+
+   // Numbers drawn so far; checkpoints save it so a resumed run gets the same distortions.
+   uint64_t position() const { return rng.position(); }
+   void seek(uint64_t position) { rng.seek(position); }
+};
+
+#endif
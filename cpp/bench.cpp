@@ -0,0 +1,790 @@
+// Native benchmarks for the engine. Build with ./build-native.sh, run from the repo root:
+//   bin/bench hogwild [threads] [epochs]
+//   bin/bench checkpoint
+//   bin/bench augment [batch]
+//   bin/bench prune [sparsity]
+//   bin/bench rng [threads]
+//   bin/bench schedule [targetAccuracy]
+//   bin/bench gemm
+//   bin/bench tensor [batch]
+//   bin/bench pipeline
+//   bin/bench cache [distinct]
+//   bin/bench json [model.json]
+//   bin/bench online [budgetMs]
+#include "augment.h"
+#include "checkpoint.h"
+#include "gemm.h"
+#include "mnist.h"
+#include "modeljson.h"
+#include "nn.h"
+#include "online.h"
+#include "parallel.h"
+#include "rng.h"
+#include "sparse.h"
+#include "tensor.h"
+#include "trainer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const int NUM_INP = 28 * 28;
+static const int NUM_OUT = 10;
+static const int HOLDOUT = 10000;
+static const unsigned int SEED = 42; // Same initial weights in every run, so timings compare like with like
+
+static NeuralNetwork makeNetwork() {
+   return NeuralNetwork(NUM_INP, {64, 64}, NUM_OUT, 0.1, SEED);
+}
+
+static double accuracy(NeuralNetwork &nn, const Dataset &d, int begin, int end) {
+   int correct = 0;
+   std::vector<double> input(NUM_INP);
+   for (int i = begin; i < end; i++) {
+      std::copy(d.inputs.begin() + (size_t)i * NUM_INP, d.inputs.begin() + (size_t)(i + 1) * NUM_INP, input.begin());
+      Matrix out = nn.feedForwardArray(input);
+      int best = 0;
+      for (int k = 1; k < NUM_OUT; k++) {
+         if (out.at(0, k) > out.at(0, best))
+            best = k;
+      }
+      correct += best == d.labels[i];
+   }
+   return 100.0 * correct / (end - begin);
+}
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+   return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void trainRange(NeuralNetwork &nn, const Dataset &d, int begin, int end) {
+   std::vector<double> input(NUM_INP), target(NUM_OUT);
+   for (int i = begin; i < end; i++) {
+      std::copy(d.inputs.begin() + (size_t)i * NUM_INP, d.inputs.begin() + (size_t)(i + 1) * NUM_INP, input.begin());
+      std::copy(d.targets.begin() + (size_t)i * NUM_OUT, d.targets.begin() + (size_t)(i + 1) * NUM_OUT,
+                target.begin());
+      nn.trainArray(input, target);
+   }
+}
+
+// One sample per trainBatch, like train.js, so augmentation applies.
+static void trainRangeBatched(NeuralNetwork &nn, const Dataset &d, int begin, int end) {
+   std::vector<double> input(NUM_INP), target(NUM_OUT);
+   for (int i = begin; i < end; i++) {
+      std::copy(d.inputs.begin() + (size_t)i * NUM_INP, d.inputs.begin() + (size_t)(i + 1) * NUM_INP, input.begin());
+      std::copy(d.targets.begin() + (size_t)i * NUM_OUT, d.targets.begin() + (size_t)(i + 1) * NUM_OUT,
+                target.begin());
+      nn.trainBatch(input, target, 1);
+   }
+}
+
+static void benchCheckpoint(const Dataset &d) {
+   const std::string path = "bench-checkpoint.bin";
+   int trainCount = d.count - HOLDOUT;
+   int every = 5000;
+
+   // Train with a background checkpoint every `every` samples, recording the stall each one costs.
+   // Augmentation is on, as in train.js, so the resume check covers the distortion stream too.
+   NeuralNetwork nn = makeNetwork();
+   nn.setAugmentation(AugmentConfig(), SEED);
+   Checkpoint ckpt;
+   double snapshotTime = 0;
+   int taken = 0;
+   {
+      CheckpointWriter writer(path);
+      for (int i = 0; i < trainCount; i += every) {
+         int end = std::min(i + every, trainCount);
+         trainRangeBatched(nn, d, i, end);
+         if (end == trainCount)
+            break;
+         auto start = std::chrono::steady_clock::now();
+         nn.snapshot(ckpt);
+         ckpt.epoch = 0;
+         ckpt.cursor = end;
+         writer.submit(ckpt);
+         snapshotTime += seconds(start);
+         taken++;
+         if (end >= trainCount / 2) {
+            writer.flush(); // Keep this one on disk for the resume check below
+            break;
+         }
+      }
+   }
+   Checkpoint saved;
+   if (!Checkpoint::load(path, saved)) {
+      std::printf("checkpoint: could not read back %s\n", path.c_str());
+      return;
+   }
+   trainRangeBatched(nn, d, saved.cursor, trainCount);
+
+   auto start = std::chrono::steady_clock::now();
+   saved.save(path);
+   double syncTime = seconds(start);
+
+   // Resume a fresh network from the file and replay the rest of the epoch.
+   NeuralNetwork resumed = makeNetwork();
+   resumed.setAugmentation(AugmentConfig(), SEED);
+   resumed.restore(saved);
+   trainRangeBatched(resumed, d, saved.cursor, trainCount);
+
+   Checkpoint a, b;
+   nn.snapshot(a);
+   resumed.snapshot(b);
+   bool exact = a.weights == b.weights && a.biases == b.biases;
+   std::remove(path.c_str());
+
+   std::printf("checkpoint: %.3f ms stall per background checkpoint (%d taken), %.3f ms for a blocking save\n",
+               1000 * snapshotTime / std::max(1, taken), taken, 1000 * syncTime);
+   std::printf("resume from sample %d: %s\n", saved.cursor, exact ? "bit-identical weights" : "MISMATCH");
+
+   // The same through a Plateau trainer. Every validation counts as stale (minDelta 1), so the rate
+   // decays every other validation and the resumed run must carry the decays and the patience count.
+   TrainerConfig config;
+   config.schedule = LrSchedule::Plateau;
+   config.validateEvery = 500;
+   config.patience = 2;
+   config.minDelta = 1;
+   config.decay = 0.9;
+   std::vector<double> valIn(d.inputs.begin() + (size_t)trainCount * NUM_INP,
+                             d.inputs.begin() + (size_t)(trainCount + 2000) * NUM_INP);
+   std::vector<double> valTgt(d.targets.begin() + (size_t)trainCount * NUM_OUT,
+                              d.targets.begin() + (size_t)(trainCount + 2000) * NUM_OUT);
+   auto trainWith = [&](Trainer &trainer, int begin, int end) {
+      std::vector<double> input(NUM_INP), target(NUM_OUT);
+      for (int i = begin; i < end; i++) {
+         std::copy(d.inputs.begin() + (size_t)i * NUM_INP, d.inputs.begin() + (size_t)(i + 1) * NUM_INP,
+                   input.begin());
+         std::copy(d.targets.begin() + (size_t)i * NUM_OUT, d.targets.begin() + (size_t)(i + 1) * NUM_OUT,
+                   target.begin());
+         trainer.trainBatch(input, target, 1);
+      }
+   };
+
+   NeuralNetwork full = makeNetwork();
+   Trainer fullTrainer(full, trainCount, config);
+   fullTrainer.setValidation(valIn, valTgt, 2000);
+   trainWith(fullTrainer, 0, trainCount / 2);
+   Checkpoint mid;
+   fullTrainer.snapshot(mid);
+   std::vector<uint8_t> bytes = mid.serialize();
+   trainWith(fullTrainer, trainCount / 2, trainCount);
+
+   NeuralNetwork part = makeNetwork();
+   Trainer partTrainer(part, trainCount, config);
+   partTrainer.setValidation(valIn, valTgt, 2000);
+   Checkpoint loaded;
+   bool ok = Checkpoint::deserialize(bytes.data(), bytes.size(), loaded) && partTrainer.restore(loaded);
+   trainWith(partTrainer, loaded.cursor, trainCount);
+
+   full.snapshot(a);
+   part.snapshot(b);
+   exact = ok && a.weights == b.weights && a.biases == b.biases && a.lrnRate == b.lrnRate;
+   std::printf("plateau trainer resume from sample %d (%d rate decays before it, %d by the end): %s\n", loaded.cursor,
+               loaded.reductions, (int)std::round(std::log(a.lrnRate / a.lrStep) / std::log(config.decay)),
+               exact ? "bit-identical weights and rate" : "MISMATCH");
+}
+
+static void benchAugment(const Dataset &d, int batch) {
+   int trainCount = d.count - HOLDOUT;
+   std::vector<double> in, tgt;
+   double usPerSample[2];
+
+   // Plain trainBatch against trainBatch augmenting every image while staging the batch.
+   for (int mode = 0; mode < 2; mode++) {
+      NeuralNetwork nn = makeNetwork();
+      if (mode == 1)
+         nn.setAugmentation(AugmentConfig(), 1);
+
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < trainCount; i += batch) {
+         int n = std::min(batch, trainCount - i);
+         in.assign(d.inputs.begin() + (size_t)i * NUM_INP, d.inputs.begin() + (size_t)(i + n) * NUM_INP);
+         tgt.assign(d.targets.begin() + (size_t)i * NUM_OUT, d.targets.begin() + (size_t)(i + n) * NUM_OUT);
+         nn.trainBatch(in, tgt, n);
+      }
+      double rate = trainCount / seconds(start);
+      usPerSample[mode] = 1e6 / rate;
+
+      const char *names[] = {"no augmentation    ", "with augmentation  "};
+      std::printf("%s: %9.0f samples/s, accuracy %.2f%%\n", names[mode], rate, accuracy(nn, d, trainCount, d.count));
+   }
+   // Where the extra time goes: the distortions themselves, and denser first-layer inputs
+   // (the matrix kernels skip zero pixels, and distortions spread the strokes).
+   Augmenter augmenter(28, 28, 1);
+   std::vector<double> augmented((size_t)trainCount * NUM_INP);
+   auto start = std::chrono::steady_clock::now();
+   augmenter.augmentBatch(d.inputs.data(), augmented.data(), trainCount);
+   double perImage = seconds(start) / trainCount;
+   size_t before = 0, after = 0;
+   for (size_t i = 0; i < augmented.size(); i++) {
+      before += d.inputs[i] != 0;
+      after += augmented[i] != 0;
+   }
+   std::printf("augmentation alone : %9.2f us/image; nonzero pixels %.1f%% -> %.1f%%\n", 1e6 * perImage,
+               100.0 * before / augmented.size(), 100.0 * after / augmented.size());
+   double extra = usPerSample[1] - usPerSample[0];
+   std::printf("training cost      : %.2fx, +%.2f us/sample (%.2f distortion, %.2f denser first layer)\n",
+               usPerSample[1] / usPerSample[0], extra, 1e6 * perImage, extra - 1e6 * perImage);
+}
+
+static double accuracyOf(const std::vector<double> &outputs, const Dataset &d, int begin) {
+   int n = outputs.size() / NUM_OUT;
+   int correct = 0;
+   for (int i = 0; i < n; i++) {
+      const double *o = &outputs[(size_t)i * NUM_OUT];
+      correct += std::max_element(o, o + NUM_OUT) - o == d.labels[begin + i];
+   }
+   return 100.0 * correct / n;
+}
+
+static void benchPrune(const Dataset &d, double sparsity) {
+   int trainCount = d.count - HOLDOUT;
+   std::vector<double> holdout(d.inputs.begin() + (size_t)trainCount * NUM_INP, d.inputs.end());
+
+   NeuralNetwork nn = makeNetwork();
+   trainRange(nn, d, 0, trainCount);
+   std::printf("dense            : accuracy %.2f%%\n", accuracyOf(nn.predictBatch(holdout, HOLDOUT), d, trainCount));
+
+   double actual = nn.prune(sparsity);
+   std::printf("pruned to %4.1f%% : accuracy %.2f%%\n", 100 * actual,
+               accuracyOf(nn.predictBatch(holdout, HOLDOUT), d, trainCount));
+
+   trainRange(nn, d, 0, trainCount); // Fine-tune with the mask pinned
+   std::printf("fine-tuned       : accuracy %.2f%%\n", accuracyOf(nn.predictBatch(holdout, HOLDOUT), d, trainCount));
+
+   SparseNetwork sparse(nn);
+   std::printf("sparse CSR       : accuracy %.2f%%\n",
+               accuracyOf(sparse.predictBatch(holdout, HOLDOUT), d, trainCount));
+
+   Checkpoint ckpt;
+   nn.snapshot(ckpt);
+   size_t denseFile = ckpt.serialize().size();
+   size_t sparseFile = sparse.serialize().size();
+   size_t denseMem = 0;
+   for (int i = 0; i < nn.getNumLayers() - 1; i++) {
+      denseMem += (size_t)(nn.getLayerSize(i) + 1) * nn.getLayerSize(i + 1) * sizeof(double);
+   }
+   std::printf("model file %zu -> %zu bytes (%.1fx), memory %zu -> %zu bytes (%.1fx)\n", denseFile, sparseFile,
+               (double)denseFile / sparseFile, denseMem, sparse.getByteSize(), (double)denseMem / sparse.getByteSize());
+
+   // The compact file has to load back into the same model.
+   std::vector<uint8_t> bytes = sparse.serialize();
+   SparseNetwork loaded;
+   bool ok = SparseNetwork::deserialize(bytes.data(), bytes.size(), loaded);
+   bool same = ok && loaded.predictBatch(holdout, HOLDOUT) == sparse.predictBatch(holdout, HOLDOUT);
+   bool truncated = SparseNetwork::deserialize(bytes.data(), bytes.size() - 1, loaded);
+   std::printf("model file round trip: %s, truncated file %s\n", same ? "identical predictions" : "MISMATCH",
+               truncated ? "ACCEPTED" : "rejected");
+
+   for (int batch : {1, 64}) {
+      int reps = HOLDOUT / batch;
+      auto start = std::chrono::steady_clock::now();
+      for (int r = 0; r < reps; r++) {
+         std::vector<double> in(holdout.begin() + (size_t)r * batch * NUM_INP,
+                                holdout.begin() + (size_t)(r + 1) * batch * NUM_INP);
+         nn.predictBatch(in, batch);
+      }
+      double denseRate = (double)reps * batch / seconds(start);
+      start = std::chrono::steady_clock::now();
+      for (int r = 0; r < reps; r++) {
+         std::vector<double> in(holdout.begin() + (size_t)r * batch * NUM_INP,
+                                holdout.begin() + (size_t)(r + 1) * batch * NUM_INP);
+         sparse.predictBatch(in, batch);
+      }
+      double sparseRate = (double)reps * batch / seconds(start);
+      std::printf("batch %2d inference: dense %9.0f/s, sparse %9.0f/s (%.2fx)\n", batch, denseRate, sparseRate,
+                  sparseRate / denseRate);
+   }
+}
+
+static void benchHogwild(const Dataset &d, int threads, int epochs) {
+   int trainCount = d.count - HOLDOUT;
+
+   // Baseline: the serial per-sample train() loop.
+   NeuralNetwork serial = makeNetwork();
+   std::vector<double> input(NUM_INP), target(NUM_OUT);
+   auto start = std::chrono::steady_clock::now();
+   for (int e = 0; e < epochs; e++) {
+      for (int i = 0; i < trainCount; i++) {
+         std::copy(d.inputs.begin() + (size_t)i * NUM_INP, d.inputs.begin() + (size_t)(i + 1) * NUM_INP,
+                   input.begin());
+         std::copy(d.targets.begin() + (size_t)i * NUM_OUT, d.targets.begin() + (size_t)(i + 1) * NUM_OUT,
+                   target.begin());
+         serial.trainArray(input, target);
+      }
+   }
+   double serialTime = seconds(start);
+   double serialRate = (double)trainCount * epochs / serialTime;
+   std::printf("train     1 thread : %9.0f samples/s, accuracy %.2f%%\n", serialRate,
+               accuracy(serial, d, trainCount, d.count));
+
+   NeuralNetwork hogwild = makeNetwork();
+   start = std::chrono::steady_clock::now();
+   for (int e = 0; e < epochs; e++) {
+      hogwild.trainHogwild(d.inputs, d.targets, trainCount, threads);
+   }
+   double hogTime = seconds(start);
+   double hogRate = (double)trainCount * epochs / hogTime;
+   std::printf("hogwild %3d threads: %9.0f samples/s, accuracy %.2f%% (%.2fx)\n", threads, hogRate,
+               accuracy(hogwild, d, trainCount, d.count), hogRate / serialRate);
+}
+
+static void benchRng(int threads) {
+   // Fills and permutations must not depend on how the work is split.
+   Matrix serial(2048, 2048), parallel(2048, 2048);
+   auto start = std::chrono::steady_clock::now();
+   serial.randomWeights(SEED, 0, false, 1);
+   double serialTime = seconds(start);
+   start = std::chrono::steady_clock::now();
+   parallel.randomWeights(SEED, 0, false, threads);
+   double parallelTime = seconds(start);
+   bool same = std::equal(serial.values(), serial.values() + 2048 * 2048, parallel.values());
+   std::printf("fill 2048x2048:  1 thread %.1f ms, %d threads %.1f ms (%.2fx), identical: %s\n", serialTime * 1e3,
+               threads, parallelTime * 1e3, serialTime / parallelTime, same ? "yes" : "NO");
+
+   int count = 60000;
+   start = std::chrono::steady_clock::now();
+   std::vector<int> a = permutation(count, SEED, 0, 1);
+   serialTime = seconds(start);
+   start = std::chrono::steady_clock::now();
+   std::vector<int> b = permutation(count, SEED, 0, threads);
+   parallelTime = seconds(start);
+   std::vector<int> sorted = a;
+   std::sort(sorted.begin(), sorted.end());
+   bool valid = true;
+   for (int i = 0; i < count; i++) {
+      valid = valid && sorted[i] == i;
+   }
+   std::printf("permutation %d: 1 thread %.2f ms, %d threads %.2f ms, identical: %s, valid: %s, next epoch differs: %s\n",
+               count, serialTime * 1e3, threads, parallelTime * 1e3, a == b ? "yes" : "NO", valid ? "yes" : "NO",
+               a != permutation(count, SEED, 1) ? "yes" : "NO");
+
+   NeuralNetwork n1 = makeNetwork(), n2 = makeNetwork();
+   MatrixView w1 = n1.getWeights(0), w2 = n2.getWeights(0);
+   std::printf("seeded networks identical: %s\n",
+               std::equal(w1.values(), w1.values() + w1.getRows() * w1.getCols(), w2.values()) ? "yes" : "NO");
+}
+
+static void benchSchedule(const Dataset &d, double target) {
+   int trainCount = d.count - HOLDOUT;
+   std::vector<double> valIn(d.inputs.begin() + (size_t)trainCount * NUM_INP, d.inputs.end());
+   std::vector<double> valTgt(d.targets.begin() + (size_t)trainCount * NUM_OUT, d.targets.end());
+
+   auto run = [&](const char *name, LrSchedule schedule, int maxEpochs, double targetAccuracy) {
+      NeuralNetwork nn = makeNetwork();
+      TrainerConfig config;
+      config.schedule = schedule;
+      config.maxEpochs = maxEpochs;
+      config.targetAccuracy = targetAccuracy;
+      if (targetAccuracy <= 0)
+         config.patience = 1 << 30; // Never stop early
+      Trainer trainer(nn, trainCount, config);
+      trainer.setValidation(valIn, valTgt, HOLDOUT);
+      StopReason reason = trainer.fit(d.inputs, d.targets, SEED);
+      const Validation &last = trainer.getHistory().back();
+      const char *why[] = {"running", "target", "plateau", "max epochs"};
+      std::printf("%-15s: stop (%-10s) after %5.2f epochs, %6.2f s, accuracy %.2f%%, loss %.4f, rate %.4f\n", name,
+                  why[(int)reason], last.epoch, last.seconds, 100 * last.accuracy, last.loss, last.lrnRate);
+   };
+
+   // The old train.js behaviour (3 fixed epochs) against each schedule stopping at the target.
+   run("fixed 3 epochs", LrSchedule::Constant, 3, 0);
+   run("constant", LrSchedule::Constant, 10, target);
+   run("step", LrSchedule::Step, 10, target);
+   run("cosine", LrSchedule::Cosine, 10, target);
+   run("plateau", LrSchedule::Plateau, 10, target);
+}
+
+static void benchGemm(const Dataset &d) {
+   // Tunes every layer shape of the 784-64-64-10 network at typical batch sizes on MNIST
+   // inputs (mostly zeros) and sigmoid-like hidden activations, then writes the cache.
+   GemmTuner &tuner = GemmTuner::instance();
+   tuner.clear();
+   tuner.setAutotune(true);
+   std::printf("target %s\n", GemmTuner::target());
+
+   CounterRng rng(SEED, 1);
+   const int shapes[][2] = {{NUM_INP, 64}, {64, 64}, {64, NUM_OUT}};
+   for (int batch : {1, 8, 32, 256}) {
+      for (const int *shape : shapes) {
+         int K = shape[0], N = shape[1];
+         std::vector<double> a((size_t)batch * K), b((size_t)K * N), out((size_t)batch * N);
+         for (size_t i = 0; i < a.size(); i++) {
+            a[i] = K == NUM_INP ? d.inputs[i % d.inputs.size()] : rng.uniform(i);
+         }
+         for (size_t i = 0; i < b.size(); i++) {
+            b[i] = rng.uniform(a.size() + i, -1.0, 1.0);
+         }
+
+         double defaultNs = GemmTuner::measure(GemmConfig(), a.data(), b.data(), batch, N, K);
+         tuner.multiply(a.data(), b.data(), out.data(), batch, N, K);
+         GemmConfig best = tuner.lookup(batch, N, K);
+         std::printf("M %3d N %3d K %3d: default %9.0f ns, tuned %9.0f ns (%.2fx) rows %d blockK %3d skipZeros %d\n",
+                     batch, N, K, defaultNs, best.nsPerCall, defaultNs / best.nsPerCall, best.rows, best.blockK,
+                     best.skipZeros);
+      }
+   }
+   const char *path = std::getenv("NN_GEMM_CACHE");
+   std::printf("cache written to %s\n", path ? path : "gemm-tune.txt");
+}
+
+static void benchTensor(const Dataset &d, int batch) {
+   // One epoch of trainBatch fed by per-batch copies (the old pattern) against slices of one
+   // dataset tensor. Both must end with identical weights.
+   int trainCount = d.count - HOLDOUT;
+   Tensor x({d.count, NUM_INP}, std::vector<double>(d.inputs));
+   Tensor y({d.count, NUM_OUT}, std::vector<double>(d.targets));
+
+   NeuralNetwork copied = makeNetwork();
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+   size_t copiedBytes = 0;
+   for (int b = 0; b + batch <= trainCount; b += batch) {
+      std::vector<double> in(d.inputs.begin() + (size_t)b * NUM_INP, d.inputs.begin() + (size_t)(b + batch) * NUM_INP);
+      std::vector<double> tgt(d.targets.begin() + (size_t)b * NUM_OUT,
+                              d.targets.begin() + (size_t)(b + batch) * NUM_OUT);
+      copiedBytes += (in.size() + tgt.size()) * sizeof(double);
+      copied.trainBatch(in, tgt, batch);
+   }
+   double copiedSeconds = seconds(start);
+
+   NeuralNetwork sliced = makeNetwork();
+   start = std::chrono::steady_clock::now();
+   for (int b = 0; b + batch <= trainCount; b += batch) {
+      sliced.trainBatch(x.slice(b, b + batch), y.slice(b, b + batch));
+   }
+   double slicedSeconds = seconds(start);
+
+   int batches = trainCount / batch;
+   std::printf("batch %d, %d batches\n", batch, batches);
+   // Bytes the engine stages itself (augmented or strided rows) count as copies too.
+   std::printf("copied batches: %6.3f s, %8.1f MB copied into batch arrays\n", copiedSeconds,
+               (copiedBytes + copied.getStagedBytes()) / 1e6);
+   std::printf("tensor slices : %6.3f s, %8.1f MB copied into batch arrays\n", slicedSeconds,
+               sliced.getStagedBytes() / 1e6);
+
+   // Views: a transposed slice reads the same storage without copying until made contiguous.
+   Tensor t = x.slice(0, batch).transpose();
+   std::printf("transposed view: shape [%d, %d], contiguous %s, shares storage %s\n", t.getShape()[0],
+               t.getShape()[1], t.isContiguous() ? "yes" : "no", t.values() == x.values() ? "yes" : "no");
+
+   bool same = true;
+   for (int i = 0; i < copied.getNumLayers() - 1; i++) {
+      MatrixView w1 = copied.getWeights(i), w2 = sliced.getWeights(i);
+      same &= std::equal(w1.values(), w1.values() + w1.getRows() * w1.getCols(), w2.values());
+   }
+   std::vector<double> p1 = copied.predictBatch(std::vector<double>(d.inputs.begin() + (size_t)trainCount * NUM_INP,
+                                                                    d.inputs.end()),
+                                                HOLDOUT);
+   std::vector<double> p2 = sliced.predictBatch(x.slice(trainCount));
+   std::printf("identical weights %s, identical predictions %s\n", same ? "yes" : "NO", p1 == p2 ? "yes" : "NO");
+}
+
+static bool sameWeights(const NeuralNetwork &a, const NeuralNetwork &b) {
+   std::vector<double> pa, pb;
+   a.getParameters(pa);
+   b.getParameters(pb);
+   return pa == pb;
+}
+
+static void benchPipeline(const Dataset &d) {
+   // One epoch of small-batch SGD: the serial trainBatch loop against the layer pipeline
+   // (one stage per weight layer, one microbatch in flight per stage, stashed weights).
+   // A window of one microbatch must reproduce the serial loop exactly.
+   int trainCount = d.count - HOLDOUT;
+   std::vector<double> holdout(d.inputs.begin() + (size_t)trainCount * NUM_INP, d.inputs.end());
+   std::printf("%d hardware threads\n", hardwareThreads());
+   for (int batch = 1; batch <= 8; batch++) {
+      NeuralNetwork serial = makeNetwork();
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (int b = 0; b < trainCount; b += batch) {
+         int rows = std::min(batch, trainCount - b);
+         std::vector<double> in(d.inputs.begin() + (size_t)b * NUM_INP, d.inputs.begin() + (size_t)(b + rows) * NUM_INP);
+         std::vector<double> tgt(d.targets.begin() + (size_t)b * NUM_OUT,
+                                 d.targets.begin() + (size_t)(b + rows) * NUM_OUT);
+         serial.trainBatch(in, tgt, rows);
+      }
+      double serialSeconds = seconds(start);
+
+      PipelineConfig config;
+      config.batchSize = batch;
+      NeuralNetwork piped = makeNetwork();
+      start = std::chrono::steady_clock::now();
+      piped.trainPipelined(d.inputs, d.targets, trainCount, config);
+      double pipedSeconds = seconds(start);
+
+      config.maxInFlight = 1;
+      NeuralNetwork exact = makeNetwork();
+      exact.trainPipelined(d.inputs, d.targets, trainCount, config);
+
+      std::printf("batch %d: serial %7.0f samples/s %.2f%% | pipelined %7.0f samples/s %.2f%% (%.2fx) | window 1 "
+                  "identical %s\n",
+                  batch, trainCount / serialSeconds, accuracyOf(serial.predictBatch(holdout, HOLDOUT), d, trainCount),
+                  trainCount / pipedSeconds, accuracyOf(piped.predictBatch(holdout, HOLDOUT), d, trainCount),
+                  serialSeconds / pipedSeconds, sameWeights(serial, exact) ? "yes" : "NO");
+   }
+}
+
+static void benchCache(const Dataset &d, int distinct) {
+   // UI-like traffic: repeated queries on a few canvases, with a training step every 500
+   // queries. The cached network must answer exactly like the uncached one.
+   const int queries = 20000;
+   NeuralNetwork plain = makeNetwork();
+   NeuralNetwork cached = makeNetwork();
+   cached.setInferenceCache(64);
+   std::vector<double> tgt(d.targets.begin(), d.targets.begin() + NUM_OUT);
+
+   double plainSeconds = 0, cachedSeconds = 0;
+   bool same = true;
+   for (int q = 0; q < queries; q++) {
+      int image = (int)(CounterRng(SEED, 2).at(q) % distinct);
+      std::vector<double> in(d.inputs.begin() + (size_t)image * NUM_INP, d.inputs.begin() + (size_t)(image + 1) * NUM_INP);
+      if (q % 500 == 499) {
+         plain.trainArray(in, tgt);
+         cached.trainArray(in, tgt);
+      }
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      Matrix a = plain.feedForwardArray(in);
+      plainSeconds += seconds(start);
+      start = std::chrono::steady_clock::now();
+      Matrix b = cached.feedForwardArray(in);
+      cachedSeconds += seconds(start);
+      same &= std::equal(a.values(), a.values() + NUM_OUT, b.values()) &&
+              plain.getNeuronVal(1, 0) == cached.getNeuronVal(1, 0);
+   }
+   CacheStats stats = cached.getInferenceCacheStats();
+   std::printf("%d queries over %d canvases: uncached %.1f us/query, cached %.1f us/query (%.1fx)\n", queries,
+               distinct, 1e6 * plainSeconds / queries, 1e6 * cachedSeconds / queries, plainSeconds / cachedSeconds);
+   std::printf("hit rate %.1f%% (%d entries), identical results %s\n",
+               100 * stats.hits / (stats.hits + stats.misses), stats.entries, same ? "yes" : "NO");
+}
+
+// The loader bin/server used before parseModelJson: strtod on every number into nested vectors.
+static std::vector<Matrix> strtodMatrices(const std::string &text, const char *prefix) {
+   std::vector<Matrix> out;
+   for (int i = 0;; i++) {
+      size_t at = text.find("\"" + std::string(prefix) + std::to_string(i) + "\"");
+      if (at == std::string::npos)
+         break;
+      std::vector<std::vector<double>> rows;
+      int depth = 0;
+      const char *s = text.c_str();
+      for (size_t k = text.find('[', at); k < text.size(); k++) {
+         if (s[k] == '[') {
+            if (++depth == 2)
+               rows.emplace_back();
+         } else if (s[k] == ']') {
+            if (--depth == 0)
+               break;
+         } else if (depth == 2 && (s[k] == '-' || (s[k] >= '0' && s[k] <= '9'))) {
+            char *end;
+            rows.back().push_back(std::strtod(s + k, &end));
+            k = end - s - 1;
+         }
+      }
+      out.push_back(Matrix(rows.size(), rows.empty() ? 0 : rows[0].size(), rows));
+   }
+   return out;
+}
+
+static void benchJson(const std::string &path) {
+   std::ifstream f(path);
+   if (!f) {
+      std::printf("cannot read %s\n", path.c_str());
+      return;
+   }
+   std::stringstream ss;
+   ss << f.rdbuf();
+   std::string text = ss.str();
+
+   double strtodSeconds = 1e300, fastSeconds = 1e300;
+   std::vector<Matrix> oldWeights, oldBiases, weights, biases;
+   for (int rep = 0; rep < 5; rep++) {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      oldWeights = strtodMatrices(text, "weights");
+      oldBiases = strtodMatrices(text, "bias");
+      strtodSeconds = std::min(strtodSeconds, seconds(start));
+      start = std::chrono::steady_clock::now();
+      parseModelJson(text, weights, biases);
+      fastSeconds = std::min(fastSeconds, seconds(start));
+   }
+   auto equal = [](const Matrix &a, const Matrix &b) {
+      return a.getRows() == b.getRows() && a.getCols() == b.getCols() &&
+             std::equal(a.values(), a.values() + (size_t)a.getRows() * a.getCols(), b.values());
+   };
+   bool same = weights.size() == oldWeights.size() && biases.size() == oldBiases.size();
+   for (size_t i = 0; same && i < weights.size(); i++) {
+      same = equal(weights[i], oldWeights[i]) && equal(biases[i], oldBiases[i]);
+   }
+   std::printf("%s: %.1f MB, %zu layers\n", path.c_str(), text.size() / 1e6, weights.size());
+   std::printf("strtod loader    : %7.2f ms\n", 1e3 * strtodSeconds);
+   std::printf("parseModelJson   : %7.2f ms (%.1fx), identical values %s\n", 1e3 * fastSeconds,
+               strtodSeconds / fastSeconds, same ? "yes" : "NO");
+
+   // Random values printed with 15 to 17 significant digits must read back exactly as strtod does.
+   CounterRng rng(SEED, 3);
+   int mismatches = 0;
+   char buf[64];
+   for (int i = 0; i < 1000000; i++) {
+      double v = rng.uniform(i, -1.0, 1.0) * (i % 7 == 0 ? 1e-5 : 1.0);
+      std::snprintf(buf, sizeof(buf), "%.*g", 15 + i % 3, v);
+      const char *p = buf;
+      double parsed;
+      mismatches += !parseJsonNumber(p, buf + std::strlen(buf), parsed) || parsed != std::strtod(buf, nullptr);
+   }
+   std::printf("1000000 random numbers: %d mismatches against strtod\n", mismatches);
+}
+
+static void benchOnline(const Dataset &d, double budgetMs) {
+   // A trained base model, then a user who keeps drawing one digit (label 7 from the held-out
+   // half) at the page's learning rate: one trainArray per drawing against the online learner
+   // (ring buffer + rehearsal pool of training images, step(budgetMs) per drawing).
+   int trainCount = d.count - HOLDOUT;
+   int half = trainCount + HOLDOUT / 2;
+   NeuralNetwork base = makeNetwork();
+   auto sample = [&](const std::vector<double> &v, int i, int size, int n = 1) {
+      return std::vector<double>(v.begin() + (size_t)i * size, v.begin() + (size_t)(i + n) * size);
+   };
+   for (int b = 0; b + 32 <= trainCount; b += 32) {
+      base.trainBatch(sample(d.inputs, b, NUM_INP, 32), sample(d.targets, b, NUM_OUT, 32), 32);
+   }
+   std::vector<double> test(d.inputs.begin() + (size_t)half * NUM_INP, d.inputs.end());
+   std::vector<int> user;
+   for (int i = trainCount; i < half && user.size() < 200; i++) {
+      if (d.labels[i] == 7)
+         user.push_back(i);
+   }
+   std::printf("base model: held-out accuracy %.2f%%; %zu user drawings of a 7\n",
+               accuracyOf(base.predictBatch(test, d.count - half), d, half), user.size());
+
+   NeuralNetwork perSample = base;
+   perSample.setLrnRate(1.0);
+   NeuralNetwork online = base;
+   online.setLrnRate(1.0);
+   OnlineLearner learner(online, OnlineConfig(), SEED);
+   learner.addPool(d.inputs, d.targets, 2000);
+   NeuralNetwork noPool = base;
+   noPool.setLrnRate(1.0);
+   OnlineLearner drawingsOnly(noPool, OnlineConfig(), SEED);
+
+   double oldMax = 0, newMax = 0, newTotal = 0;
+   for (int i : user) {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      perSample.trainArray(sample(d.inputs, i, NUM_INP), sample(d.targets, i, NUM_OUT));
+      oldMax = std::max(oldMax, seconds(start));
+
+      start = std::chrono::steady_clock::now();
+      learner.addSample(sample(d.inputs, i, NUM_INP), sample(d.targets, i, NUM_OUT));
+      learner.step(budgetMs);
+      double t = seconds(start);
+      newMax = std::max(newMax, t);
+      newTotal += t;
+
+      // The page keeps stepping for a while after each drawing
+      drawingsOnly.addSample(sample(d.inputs, i, NUM_INP), sample(d.targets, i, NUM_OUT));
+      for (int frame = 0; frame < 30; frame++) {
+         drawingsOnly.step(budgetMs);
+      }
+   }
+   std::printf("trainArray per drawing: held-out accuracy %.2f%%, max %.3f ms per drawing\n",
+               accuracyOf(perSample.predictBatch(test, d.count - half), d, half), 1e3 * oldMax);
+   std::printf("online step(%.1f ms)   : held-out accuracy %.2f%%, mean %.3f ms, max %.3f ms per drawing, %.0f samples "
+               "trained\n",
+               budgetMs, accuracyOf(online.predictBatch(test, d.count - half), d, half), 1e3 * newTotal / user.size(),
+               1e3 * newMax, learner.getSamplesTrained());
+   std::printf("online without a pool: held-out accuracy %.2f%%, %.0f samples trained\n",
+               accuracyOf(noPool.predictBatch(test, d.count - half), d, half), drawingsOnly.getSamplesTrained());
+}
+
+int main(int argc, char **argv) {
+   std::string mode = argc > 1 ? argv[1] : "hogwild";
+
+   if (mode == "hogwild") {
+      int threads = argc > 2 ? std::atoi(argv[2]) : hardwareThreads();
+      int epochs = argc > 3 ? std::atoi(argv[3]) : 1;
+      Dataset d = loadMNIST();
+      benchHogwild(d, threads, epochs);
+      return 0;
+   }
+
+   if (mode == "checkpoint") {
+      Dataset d = loadMNIST();
+      benchCheckpoint(d);
+      return 0;
+   }
+
+   if (mode == "augment") {
+      int batch = argc > 2 ? std::atoi(argv[2]) : 1;
+      Dataset d = loadMNIST();
+      benchAugment(d, std::max(1, batch));
+      return 0;
+   }
+
+   if (mode == "prune") {
+      double sparsity = argc > 2 ? std::atof(argv[2]) : 0.9;
+      Dataset d = loadMNIST();
+      benchPrune(d, sparsity);
+      return 0;
+   }
+
+   if (mode == "schedule") {
+      double target = argc > 2 ? std::atof(argv[2]) : 0.95;
+      Dataset d = loadMNIST();
+      benchSchedule(d, target);
+      return 0;
+   }
+
+   if (mode == "gemm") {
+      Dataset d = loadMNIST();
+      benchGemm(d);
+      return 0;
+   }
+
+   if (mode == "tensor") {
+      int batch = argc > 2 ? std::atoi(argv[2]) : 32;
+      Dataset d = loadMNIST();
+      benchTensor(d, std::max(1, batch));
+      return 0;
+   }
+
+   if (mode == "pipeline") {
+      Dataset d = loadMNIST();
+      benchPipeline(d);
+      return 0;
+   }
+
+   if (mode == "cache") {
+      int distinct = argc > 2 ? std::atoi(argv[2]) : 20;
+      Dataset d = loadMNIST();
+      benchCache(d, std::max(1, distinct));
+      return 0;
+   }
+
+   if (mode == "json") {
+      benchJson(argc > 2 ? argv[2] : "model.json");
+      return 0;
+   }
+
+   if (mode == "online") {
+      double budget = argc > 2 ? std::atof(argv[2]) : 4.0;
+      Dataset d = loadMNIST();
+      benchOnline(d, budget);
+      return 0;
+   }
+
+   if (mode == "rng") {
+      int threads = argc > 2 ? std::atoi(argv[2]) : hardwareThreads();
+      benchRng(std::max(1, threads));
+      return 0;
+   }
+
+   std::fprintf(stderr,
+                "Usage: bench hogwild [threads] [epochs] | checkpoint | augment [batch] | prune [sparsity] | rng [threads] | "
+                "schedule [targetAccuracy] | gemm | tensor [batch] | pipeline | cache [distinct] | json [model.json] | online [budgetMs]\n");
+   return 1;
+}
@@ -0,0 +1,82 @@
+#include "cache.h"
+#include <algorithm>
+
+InferenceCache::InferenceCache(int capacity, int levels)
+    : capacity(std::max(1, capacity)), levels(std::min(256, std::max(2, levels))) {}
+
+template <typename T> static InferenceCache::Key quantize(const T *input, size_t size, int levels) {
+   // FNV-1a over the bins, which are a byte each
+   InferenceCache::Key key;
+   key.bins.resize(size);
+   uint64_t hash = 1469598103934665603ull;
+   double scale = levels - 1;
+   for (size_t i = 0; i < size; i++) {
+      double v = std::min(1.0, std::max(0.0, (double)input[i]));
+      uint8_t bin = (uint8_t)(v * scale + 0.5);
+      key.bins[i] = bin;
+      hash = (hash ^ bin) * 1099511628211ull;
+   }
+   key.hash = hash ^ size;
+   return key;
+}
+
+InferenceCache::Key InferenceCache::makeKey(const double *input, size_t size) const {
+   return quantize(input, size, levels);
+}
+
+InferenceCache::Key InferenceCache::makeKey(const float *input, size_t size) const {
+   return quantize(input, size, levels);
+}
+
+void InferenceCache::checkVersion(uint64_t weightsVersion) {
+   if (weightsVersion == version)
+      return;
+   entries.clear();
+   index.clear();
+   version = weightsVersion;
+}
+
+bool InferenceCache::lookup(const Key &key, uint64_t weightsVersion, std::vector<double> &value) {
+   std::lock_guard<std::mutex> lk(lock);
+   checkVersion(weightsVersion);
+   auto it = index.find(key.hash);
+   if (it == index.end() || it->second->key.bins != key.bins) {
+      stats.misses++;
+      return false;
+   }
+   entries.splice(entries.begin(), entries, it->second);
+   value = it->second->value;
+   stats.hits++;
+   return true;
+}
+
+void InferenceCache::insert(Key &&key, uint64_t weightsVersion, const std::vector<double> &value) {
+   std::lock_guard<std::mutex> lk(lock);
+   checkVersion(weightsVersion);
+   auto it = index.find(key.hash);
+   if (it != index.end()) {
+      // Same input computed twice, or a hash collision: the newer result replaces it
+      entries.erase(it->second);
+      index.erase(it);
+   } else if ((int)entries.size() >= capacity) {
+      index.erase(entries.back().key.hash);
+      entries.pop_back();
+   }
+   uint64_t hash = key.hash;
+   entries.push_front(Entry{std::move(key), value});
+   index[hash] = entries.begin();
+}
+
+CacheStats InferenceCache::getStats() {
+   std::lock_guard<std::mutex> lk(lock);
+   CacheStats s = stats;
+   s.entries = entries.size();
+   return s;
+}
+
+void InferenceCache::clear() {
+   std::lock_guard<std::mutex> lk(lock);
+   entries.clear();
+   index.clear();
+   stats = CacheStats();
+}
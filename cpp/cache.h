@@ -0,0 +1,55 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct CacheStats {
+   double hits = 0;
+   double misses = 0;
+   int entries = 0;
+};
+
+// Least-recently-used cache of inference results, keyed on the input quantized to `levels`
+// steps over [0, 1] so that near-identical canvases share an entry. Every entry belongs to
+// one weights version; a lookup with any other version empties the cache first. Safe to
+// share between threads.
+class InferenceCache {
+public:
+   struct Key {
+      uint64_t hash = 0;
+      std::vector<uint8_t> bins; // Quantized input, compared on a hash match
+   };
+
+private:
+   struct Entry {
+      Key key;
+      std::vector<double> value;
+   };
+
+   std::mutex lock;
+   std::list<Entry> entries; // Most recently used first
+   std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+   int capacity;
+   int levels;
+   uint64_t version = 0;
+   CacheStats stats;
+
+   void checkVersion(uint64_t weightsVersion);
+
+public:
+   explicit InferenceCache(int capacity, int levels = 256);
+
+   Key makeKey(const double *input, size_t size) const;
+   Key makeKey(const float *input, size_t size) const;
+   bool lookup(const Key &key, uint64_t weightsVersion, std::vector<double> &value);
+   void insert(Key &&key, uint64_t weightsVersion, const std::vector<double> &value);
+
+   CacheStats getStats();
+   void clear();
+};
+
+#endif
@@ -0,0 +1,225 @@
+#include "checkpoint.h"
+#include "parallel.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+// Layout (host byte order, little-endian on wasm and x86):
+//   "NNCK" u32 version, u32 numLayers, u32 layerSizes[numLayers],
+//   f64 lrnRate, f64 lrStep, u32 epoch, u32 cursor, u32 rngState, u64 augmentPosition (version 2),
+//   f64 bestLoss, u32 stale, u32 reductions, f64 trainSeconds (version 3),
+//   per layer: f64 weights[in * out], f64 biases[out],
+//   u32 FNV-1a checksum of everything before it.
+static const char MAGIC[4] = {'N', 'N', 'C', 'K'};
+static const uint32_t VERSION = 3;
+
+static uint32_t fnv1a(const uint8_t *bytes, size_t size) {
+   uint32_t h = 2166136261u;
+   for (size_t i = 0; i < size; i++) {
+      h = (h ^ bytes[i]) * 16777619u;
+   }
+   return h;
+}
+
+static void putBytes(std::vector<uint8_t> &out, const void *p, size_t n) {
+   size_t at = out.size();
+   out.resize(at + n);
+   std::memcpy(out.data() + at, p, n);
+}
+
+template <typename T>
+static void put(std::vector<uint8_t> &out, const T &v) {
+   putBytes(out, &v, sizeof(T));
+}
+
+static void putArray(std::vector<uint8_t> &out, const std::vector<double> &v) {
+   putBytes(out, v.data(), v.size() * sizeof(double));
+}
+
+struct Reader {
+   const uint8_t *p;
+   const uint8_t *end;
+
+   template <typename T>
+   bool get(T &v) {
+      if ((size_t)(end - p) < sizeof(T))
+         return false;
+      std::memcpy(&v, p, sizeof(T));
+      p += sizeof(T);
+      return true;
+   }
+
+   bool getArray(std::vector<double> &v, size_t n) {
+      if ((size_t)(end - p) / sizeof(double) < n)
+         return false;
+      v.resize(n);
+      std::memcpy(v.data(), p, n * sizeof(double));
+      p += n * sizeof(double);
+      return true;
+   }
+};
+
+std::vector<uint8_t> Checkpoint::serialize() const {
+   std::vector<uint8_t> out;
+   size_t params = 0;
+   for (size_t i = 0; i < weights.size(); i++) {
+      params += weights[i].size() + biases[i].size();
+   }
+   out.reserve(64 + layerSizes.size() * 4 + params * sizeof(double));
+
+   putBytes(out, MAGIC, 4);
+   put(out, VERSION);
+   put(out, (uint32_t)layerSizes.size());
+   for (int size : layerSizes) {
+      put(out, (uint32_t)size);
+   }
+   put(out, lrnRate);
+   put(out, lrStep);
+   put(out, (uint32_t)epoch);
+   put(out, (uint32_t)cursor);
+   put(out, (uint32_t)rngState);
+   put(out, augmentPosition);
+   put(out, bestLoss);
+   put(out, (uint32_t)stale);
+   put(out, (uint32_t)reductions);
+   put(out, trainSeconds);
+   for (size_t i = 0; i < weights.size(); i++) {
+      putArray(out, weights[i]);
+      putArray(out, biases[i]);
+   }
+   put(out, fnv1a(out.data(), out.size()));
+   return out;
+}
+
+bool Checkpoint::deserialize(const uint8_t *bytes, size_t size, Checkpoint &out) {
+   if (size < 8 + sizeof(uint32_t) || std::memcmp(bytes, MAGIC, 4) != 0)
+      return false;
+   uint32_t checksum;
+   std::memcpy(&checksum, bytes + size - sizeof(uint32_t), sizeof(uint32_t));
+   if (fnv1a(bytes, size - sizeof(uint32_t)) != checksum)
+      return false;
+
+   Reader r{bytes + 4, bytes + size - sizeof(uint32_t)};
+   uint32_t version, numLayers;
+   // Version 1 files predate augmentation and resume with augmentPosition 0;
+   // versions 1 and 2 predate the trainer fields and resume with a fresh trainer state.
+   if (!r.get(version) || version < 1 || version > VERSION || !r.get(numLayers) || numLayers < 2)
+      return false;
+   // The checksum only catches corruption; a crafted count must not drive the allocation.
+   if ((size_t)(r.end - r.p) / sizeof(uint32_t) < numLayers)
+      return false;
+
+   out.layerSizes.resize(numLayers);
+   for (uint32_t i = 0; i < numLayers; i++) {
+      uint32_t s;
+      if (!r.get(s))
+         return false;
+      out.layerSizes[i] = s;
+   }
+
+   uint32_t epoch, cursor, rngState;
+   if (!r.get(out.lrnRate) || !r.get(out.lrStep) || !r.get(epoch) || !r.get(cursor) || !r.get(rngState))
+      return false;
+   out.epoch = epoch;
+   out.cursor = cursor;
+   out.rngState = rngState;
+   out.augmentPosition = 0;
+   if (version >= 2 && !r.get(out.augmentPosition))
+      return false;
+   uint32_t stale = 0, reductions = 0;
+   out.bestLoss = std::numeric_limits<double>::infinity();
+   out.trainSeconds = 0;
+   if (version >= 3 && (!r.get(out.bestLoss) || !r.get(stale) || !r.get(reductions) || !r.get(out.trainSeconds)))
+      return false;
+   out.stale = stale;
+   out.reductions = reductions;
+
+   out.weights.resize(numLayers - 1);
+   out.biases.resize(numLayers - 1);
+   for (uint32_t i = 0; i < numLayers - 1; i++) {
+      size_t in = out.layerSizes[i];
+      size_t outSize = out.layerSizes[i + 1];
+      if (!r.getArray(out.weights[i], in * outSize) || !r.getArray(out.biases[i], outSize))
+         return false;
+   }
+   return r.p == r.end;
+}
+
+bool Checkpoint::save(const std::string &path) const {
+   std::vector<uint8_t> bytes = serialize();
+   std::string tmp = path + ".tmp";
+   {
+      std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+      if (!f.write(reinterpret_cast<const char *>(bytes.data()), bytes.size()))
+         return false;
+   }
+   // rename() is atomic, so a crash mid-write never clobbers the previous checkpoint.
+   return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool Checkpoint::load(const std::string &path, Checkpoint &out) {
+   std::ifstream f(path, std::ios::binary);
+   if (!f)
+      return false;
+   std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+   return deserialize(bytes.data(), bytes.size(), out);
+}
+
+CheckpointWriter::CheckpointWriter(const std::string &path) : path(path) {
+#if NN_HAS_THREADS
+   worker = std::thread(&CheckpointWriter::run, this);
+#endif
+}
+
+CheckpointWriter::~CheckpointWriter() {
+#if NN_HAS_THREADS
+   {
+      std::lock_guard<std::mutex> lk(lock);
+      stopping = true;
+   }
+   changed.notify_all();
+   worker.join();
+#endif
+}
+
+void CheckpointWriter::submit(Checkpoint &ckpt) {
+#if NN_HAS_THREADS
+   {
+      std::lock_guard<std::mutex> lk(lock);
+      std::swap(pending, ckpt);
+      hasPending = true;
+   }
+   changed.notify_all();
+#else
+   lastOk = ckpt.save(path);
+#endif
+}
+
+bool CheckpointWriter::flush() {
+   std::unique_lock<std::mutex> lk(lock);
+   changed.wait(lk, [&] { return !hasPending && !writing; });
+   return lastOk;
+}
+
+void CheckpointWriter::run() {
+   Checkpoint current;
+   std::unique_lock<std::mutex> lk(lock);
+   while (true) {
+      changed.wait(lk, [&] { return hasPending || stopping; });
+      if (!hasPending)
+         return;
+      std::swap(current, pending);
+      hasPending = false;
+      writing = true;
+
+      lk.unlock();
+      bool ok = current.save(path);
+      lk.lock();
+
+      writing = false;
+      lastOk = ok;
+      changed.notify_all();
+   }
+}
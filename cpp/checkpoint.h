@@ -0,0 +1,66 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Everything needed to continue a training run exactly where it stopped.
+// Filled by NeuralNetwork::snapshot; the caller sets the data cursor fields, or Trainer::snapshot fills both.
+struct Checkpoint {
+   std::vector<int> layerSizes;
+   std::vector<std::vector<double>> weights; // Row-major, one entry per layer
+   std::vector<std::vector<double>> biases;
+   double lrnRate = 0;
+   double lrStep = 0;
+
+   int epoch = 0;              // Epoch in progress
+   int cursor = 0;             // Samples of that epoch already trained on
+   unsigned int rngState = 0;  // Shuffle seed; the epoch order is permutation(count, rngState, epoch)
+   uint64_t augmentPosition = 0; // Position in the augmentation stream, 0 without augmentation
+
+   // Trainer state (Trainer::snapshot); the defaults are those of a fresh trainer.
+   double bestLoss = std::numeric_limits<double>::infinity();
+   int stale = 0;
+   int reductions = 0;
+   double trainSeconds = 0; // Wall-clock time trained before the checkpoint
+
+   std::vector<uint8_t> serialize() const;
+   // Returns false on a truncated, corrupt or foreign buffer.
+   static bool deserialize(const uint8_t *bytes, size_t size, Checkpoint &out);
+
+   bool save(const std::string &path) const; // Writes path.tmp, then renames over path
+   static bool load(const std::string &path, Checkpoint &out);
+};
+
+// Writes checkpoints on a background thread so training only pays for the snapshot.
+// If a write is still running, a newer submission replaces any queued one.
+class CheckpointWriter {
+private:
+   std::string path;
+   std::mutex lock;
+   std::condition_variable changed;
+   Checkpoint pending;
+   bool hasPending = false;
+   bool writing = false;
+   bool stopping = false;
+   bool lastOk = true;
+   std::thread worker;
+
+   void run();
+
+public:
+   explicit CheckpointWriter(const std::string &path);
+   ~CheckpointWriter(); // Finishes the queued write
+
+   // Takes ownership of the snapshot's buffers; the caller may reuse ckpt afterwards.
+   void submit(Checkpoint &ckpt);
+   // Blocks until nothing is queued or being written; returns whether the last write succeeded.
+   bool flush();
+};
+
+#endif
@@ -0,0 +1,247 @@
+#include "gemm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+// Batch sizes share a tuning entry per power of two; small ones are tuned exactly.
+static int bucket(int M) {
+   if (M <= 4)
+      return M;
+   int b = 8;
+   while (b < M)
+      b *= 2;
+   return b;
+}
+
+template <int R>
+static void gemmRows(const double *a, const double *b, double *out, int rowBegin, int rowEnd, int N, int K,
+                     int k0, int k1, bool skipZeros) {
+   for (int i = rowBegin; i + R <= rowEnd; i += R) {
+      double *o[R];
+      const double *aRow[R];
+      for (int r = 0; r < R; r++) {
+         o[r] = out + (size_t)(i + r) * N;
+         aRow[r] = a + (size_t)(i + r) * K;
+      }
+      for (int k = k0; k < k1; k++) {
+         double av[R];
+         bool any = false;
+         for (int r = 0; r < R; r++) {
+            av[r] = aRow[r][k];
+            any |= av[r] != 0.0;
+         }
+         if (skipZeros && !any)
+            continue;
+         const double *bRow = b + (size_t)k * N;
+         for (int j = 0; j < N; j++) {
+            double bj = bRow[j];
+            for (int r = 0; r < R; r++) {
+               o[r][j] += av[r] * bj;
+            }
+         }
+      }
+   }
+}
+
+void GemmTuner::run(const GemmConfig &config, const double *a, const double *b, double *out, int M, int N, int K) {
+   std::fill(out, out + (size_t)M * N, 0.0);
+   int blockK = config.blockK > 0 ? config.blockK : std::max(1, K);
+   for (int k0 = 0; k0 < K; k0 += blockK) {
+      int k1 = std::min(K, k0 + blockK);
+      int full = config.rows == 4 ? M / 4 * 4 : config.rows == 2 ? M / 2 * 2 : 0;
+      if (config.rows == 4)
+         gemmRows<4>(a, b, out, 0, full, N, K, k0, k1, config.skipZeros);
+      else if (config.rows == 2)
+         gemmRows<2>(a, b, out, 0, full, N, K, k0, k1, config.skipZeros);
+      gemmRows<1>(a, b, out, full, M, N, K, k0, k1, config.skipZeros);
+   }
+}
+
+std::vector<GemmConfig> GemmTuner::candidates(int K) {
+   std::vector<GemmConfig> list;
+   for (int rows : {1, 2, 4}) {
+      for (int blockK : {0, 64, 256}) {
+         if (blockK >= K)
+            continue; // Same as no blocking
+         for (bool skipZeros : {true, false}) {
+            GemmConfig c;
+            c.rows = rows;
+            c.blockK = blockK;
+            c.skipZeros = skipZeros;
+            list.push_back(c);
+         }
+      }
+   }
+   return list;
+}
+
+const char *GemmTuner::target() {
+#if defined(__wasm_simd128__)
+   return "wasm-simd128";
+#elif defined(__EMSCRIPTEN__)
+   return "wasm";
+#elif defined(__AVX512F__)
+   return "avx512";
+#elif defined(__AVX2__)
+   return "avx2";
+#elif defined(__ARM_NEON)
+   return "neon";
+#elif defined(__SSE2__)
+   return "sse2";
+#else
+   return "generic";
+#endif
+}
+
+GemmTuner::GemmTuner() : published(nullptr), autotune(false) {
+   publishLocked(); // Not shared yet
+#ifndef __EMSCRIPTEN__
+   const char *path = std::getenv("NN_GEMM_CACHE");
+   cachePath = path ? path : "gemm-tune.txt";
+   const char *tune = std::getenv("NN_GEMM_TUNE");
+   autotune = tune && tune[0] == '1';
+   load(cachePath);
+#endif
+}
+
+GemmTuner &GemmTuner::instance() {
+   static GemmTuner tuner;
+   return tuner;
+}
+
+double GemmTuner::measure(const GemmConfig &config, const double *a, const double *b, int M, int N, int K) {
+   using Clock = std::chrono::steady_clock;
+   std::vector<double> scratch((size_t)M * N);
+   // Best of several runs of at least 0.2 ms each, so small shapes are not timer noise.
+   double fastest = 1e300;
+   for (int rep = 0; rep < 5; rep++) {
+      int calls = 0;
+      Clock::time_point start = Clock::now();
+      double elapsed;
+      do {
+         run(config, a, b, scratch.data(), M, N, K);
+         calls++;
+         elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+      } while (elapsed < 2e5);
+      fastest = std::min(fastest, elapsed / calls);
+   }
+   return fastest;
+}
+
+GemmConfig GemmTuner::tune(const double *a, const double *b, int M, int N, int K) {
+   GemmConfig best;
+   best.nsPerCall = -1;
+   for (GemmConfig c : candidates(K)) {
+      double ns = measure(c, a, b, M, N, K);
+      if (best.nsPerCall < 0 || ns < best.nsPerCall) {
+         best = c;
+         best.nsPerCall = ns;
+      }
+   }
+   return best;
+}
+
+void GemmTuner::publishLocked() {
+   snapshots.emplace_back(new Table(table));
+   published.store(snapshots.back().get(), std::memory_order_release);
+}
+
+const GemmConfig *GemmTuner::find(const Shape &shape) const {
+   const Table *t = published.load(std::memory_order_acquire);
+   auto it = t->find(shape);
+   return it == t->end() ? nullptr : &it->second;
+}
+
+void GemmTuner::multiply(const double *a, const double *b, double *out, int M, int N, int K) {
+   Shape shape(bucket(M), N, K);
+   const GemmConfig *config = find(shape);
+   run(config ? *config : GemmConfig(), a, b, out, M, N, K);
+   if (config || !autotune)
+      return;
+   // The first call of a new shape tunes it, outside the lock so other shapes keep running.
+   // Two threads may tune the same shape; the later result wins.
+   GemmConfig best = tune(a, b, M, N, K);
+   std::lock_guard<std::mutex> lk(lock);
+   table[shape] = best;
+   publishLocked();
+#ifndef __EMSCRIPTEN__
+   std::ofstream f(cachePath);
+   f << exportCacheLocked();
+#endif
+}
+
+GemmConfig GemmTuner::lookup(int M, int N, int K) {
+   const GemmConfig *config = find(Shape(bucket(M), N, K));
+   return config ? *config : GemmConfig();
+}
+
+void GemmTuner::setAutotune(bool on) { autotune = on; }
+
+bool GemmTuner::getAutotune() { return autotune; }
+
+std::string GemmTuner::exportCache() {
+   std::lock_guard<std::mutex> lk(lock);
+   return exportCacheLocked();
+}
+
+std::string GemmTuner::exportCacheLocked() const {
+   std::ostringstream out;
+   out << "# target M N K rows blockK skipZeros nsPerCall\n";
+   for (const auto &entry : table) {
+      const GemmConfig &c = entry.second;
+      out << target() << ' ' << std::get<0>(entry.first) << ' ' << std::get<1>(entry.first) << ' '
+          << std::get<2>(entry.first) << ' ' << c.rows << ' ' << c.blockK << ' ' << c.skipZeros << ' '
+          << c.nsPerCall << '\n';
+   }
+   return out.str();
+}
+
+int GemmTuner::importCache(const std::string &text) {
+   std::istringstream in(text);
+   std::string line;
+   int loaded = 0;
+   std::lock_guard<std::mutex> lk(lock);
+   while (std::getline(in, line)) {
+      if (line.empty() || line[0] == '#')
+         continue;
+      std::istringstream fields(line);
+      std::string t;
+      int M, N, K, skip;
+      GemmConfig c;
+      if (!(fields >> t >> M >> N >> K >> c.rows >> c.blockK >> skip >> c.nsPerCall) || t != target())
+         continue;
+      if (c.rows != 1 && c.rows != 2 && c.rows != 4)
+         continue;
+      c.blockK = std::max(0, c.blockK);
+      c.skipZeros = skip != 0;
+      table[Shape(M, N, K)] = c;
+      loaded++;
+   }
+   if (loaded > 0)
+      publishLocked();
+   return loaded;
+}
+
+bool GemmTuner::save(const std::string &path) {
+   std::ofstream f(path);
+   f << exportCache();
+   return (bool)f;
+}
+
+bool GemmTuner::load(const std::string &path) {
+   std::ifstream f(path);
+   if (!f)
+      return false;
+   std::stringstream ss;
+   ss << f.rdbuf();
+   importCache(ss.str());
+   return true;
+}
+
+void GemmTuner::clear() {
+   std::lock_guard<std::mutex> lk(lock);
+   table.clear();
+   publishLocked();
+}
@@ -0,0 +1,70 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Kernel parameters for out = a * b with a (M x K), b (K x N), all row-major.
+// Every configuration sums each output in ascending k, so results are bit-identical;
+// only the speed differs between targets and shapes.
+struct GemmConfig {
+   int rows = 1;           // Rows of a sharing each row of b (register blocking: 1, 2 or 4)
+   int blockK = 0;         // k range kept in cache per pass over the rows, 0 = all of K
+   bool skipZeros = true;  // Skip zero entries of a (blank pixels)
+   double nsPerCall = 0;   // Measured when tuned
+};
+
+// Picks the GemmConfig for each (M, N, K) shape on the compiled target (wasm SIMD128, AVX2, ...).
+// With autotuning on, the first multiplication of an unseen shape benchmarks every candidate on
+// its real operands and keeps the fastest. Winners round-trip through a small text cache, which
+// native builds read from NN_GEMM_CACHE (default gemm-tune.txt) at startup and rewrite after tuning.
+class GemmTuner {
+private:
+   using Shape = std::tuple<int, int, int>; // M bucket, N, K
+   using Table = std::map<Shape, GemmConfig>;
+
+   // Every multiplication reads the table, so readers never lock: they load an immutable snapshot
+   // through an atomic pointer. Writers (tuning a new shape, import, clear) edit `table` under the
+   // lock and publish a fresh copy. Old snapshots stay alive, because a reader may still hold one;
+   // there is one per tuned shape or import, so they stay small.
+   std::mutex lock;
+   Table table;
+   std::vector<std::unique_ptr<const Table>> snapshots;
+   std::atomic<const Table *> published;
+   std::atomic<bool> autotune;
+   std::string cachePath;
+
+   GemmTuner();
+   void publishLocked();
+   const GemmConfig *find(const Shape &shape) const; // Lock-free, null if the shape is not tuned
+   std::string exportCacheLocked() const;
+   GemmConfig tune(const double *a, const double *b, int M, int N, int K);
+
+public:
+   static GemmTuner &instance();
+   static const char *target(); // Name of the instruction set the engine was compiled for
+
+   // out = a * b through the configuration for this shape
+   void multiply(const double *a, const double *b, double *out, int M, int N, int K);
+   static void run(const GemmConfig &config, const double *a, const double *b, double *out, int M, int N, int K);
+   static std::vector<GemmConfig> candidates(int K);
+   static double measure(const GemmConfig &config, const double *a, const double *b, int M, int N, int K); // ns per call
+
+   void setAutotune(bool on);
+   bool getAutotune();
+   GemmConfig lookup(int M, int N, int K);
+
+   // Cache lines: "target M N K rows blockK skipZeros nsPerCall"; entries for other targets are ignored.
+   std::string exportCache();
+   int importCache(const std::string &text); // Returns the number of entries loaded
+   bool save(const std::string &path);
+   bool load(const std::string &path);
+   void clear();
+};
+
+#endif
@@ -0,0 +1,139 @@
+// Load generator for bin/server. Build with ./build-native.sh, then:
+//   bin/loadgen [socket] [--clients N] [--inflight N] [--requests N]
+//
+// Each client keeps `inflight` requests pipelined on its own connection and
+// sends a new one whenever a response arrives.
+#include "protocol.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <sys/un.h>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static int connectTo(const std::string &path) {
+   int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   sockaddr_un addr{};
+   addr.sun_family = AF_UNIX;
+   std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+   if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+      if (fd >= 0)
+         close(fd);
+      return -1;
+   }
+   return fd;
+}
+
+// Runs one client; appends the latency of every answered request in microseconds.
+static void runClient(const std::string &path, int clientIdx, int inflight, int requests,
+                      std::vector<double> &latencies, bool &failed) {
+   int fd = connectTo(path);
+   if (fd < 0) {
+      failed = true;
+      return;
+   }
+
+   std::mt19937 gen(clientIdx);
+   std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+   InferRequest req;
+   for (float &p : req.pixels) {
+      p = dis(gen);
+   }
+
+   std::vector<Clock::time_point> sentAt(requests);
+   int sent = 0;
+   auto sendNext = [&]() {
+      req.id = sent;
+      req.pixels[sent % PROTO_NUM_INP] = dis(gen); // Vary the input a little per request
+      sentAt[sent] = Clock::now();
+      sent++;
+      return writeFull(fd, &req, sizeof(req));
+   };
+
+   for (int i = 0; i < std::min(inflight, requests); i++) {
+      if (!sendNext()) {
+         failed = true;
+         close(fd);
+         return;
+      }
+   }
+
+   InferResponse res;
+   for (int received = 0; received < requests; received++) {
+      if (!readFull(fd, &res, sizeof(res)) || res.id >= (uint32_t)requests) {
+         failed = true;
+         break;
+      }
+      latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sentAt[res.id]).count());
+      if (sent < requests && !sendNext()) {
+         failed = true;
+         break;
+      }
+   }
+   close(fd);
+}
+
+static double percentile(const std::vector<double> &sorted, double p) {
+   if (sorted.empty())
+      return 0;
+   size_t idx = std::min(sorted.size() - 1, (size_t)(p / 100.0 * sorted.size()));
+   return sorted[idx];
+}
+
+int main(int argc, char **argv) {
+   std::string socketPath = "/tmp/nn-number-rec.sock";
+   int clients = 8;
+   int inflight = 4;
+   int requests = 20000;
+   for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg == "--clients" && i + 1 < argc)
+         clients = std::atoi(argv[++i]);
+      else if (arg == "--inflight" && i + 1 < argc)
+         inflight = std::atoi(argv[++i]);
+      else if (arg == "--requests" && i + 1 < argc)
+         requests = std::atoi(argv[++i]);
+      else
+         socketPath = arg;
+   }
+   clients = std::max(1, clients);
+   inflight = std::max(1, inflight);
+
+   std::vector<std::vector<double>> latencies(clients);
+   std::vector<char> failed(clients, 0);
+   std::vector<std::thread> threads;
+   auto start = Clock::now();
+   for (int c = 0; c < clients; c++) {
+      int share = requests / clients + (c < requests % clients ? 1 : 0);
+      threads.emplace_back([&, c, share] {
+         bool f = false;
+         runClient(socketPath, c, inflight, share, latencies[c], f);
+         failed[c] = f;
+      });
+   }
+   for (auto &t : threads) {
+      t.join();
+   }
+   double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+   std::vector<double> all;
+   for (auto &l : latencies) {
+      all.insert(all.end(), l.begin(), l.end());
+   }
+   std::sort(all.begin(), all.end());
+   if (std::count(failed.begin(), failed.end(), 1) > 0) {
+      std::fprintf(stderr, "Warning: some clients failed (is bin/server running on %s?)\n", socketPath.c_str());
+   }
+
+   std::printf("%zu requests in %.2fs: %.0f req/s\n", all.size(), elapsed, all.size() / elapsed);
+   std::printf("latency ms  p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n", percentile(all, 50) / 1000,
+               percentile(all, 90) / 1000, percentile(all, 99) / 1000, percentile(all, 99.9) / 1000,
+               all.empty() ? 0.0 : all.back() / 1000);
+   return all.empty() ? 1 : 0;
+}
@@ -1,15 +1,32 @@
 #include "matrix.h"
+#include "gemm.h"
+#include "rng.h"
+#include <algorithm>
 
-Matrix::Matrix(int rows, int cols) : rows(rows), cols(cols) {
-   data.resize(rows, std::vector<double>(cols, 0.0));
+Matrix MatrixView::toMatrix() const {
+   Matrix m(rows, cols);
+   for (int i = 0; i < rows; i++) {
+      std::copy(row(i), row(i) + cols, m.values() + (size_t)i * cols);
+   }
+   return m;
 }
 
-Matrix::Matrix(int rows, int cols, const std::vector<std::vector<double>> &data) : rows(rows), cols(cols), data(data) {
+Matrix::Matrix(int rows, int cols) : rows(rows), cols(cols), data((size_t)rows * cols, 0.0) {}
+
+Matrix::Matrix(int rows, int cols, const std::vector<std::vector<double>> &data) : rows(rows), cols(cols) {
    if (data.size() != rows || (rows > 0 && data[0].size() != cols)) {
       throw std::invalid_argument("Incorrect data dimensions!");
    }
+   setData(data);
+}
+
+Matrix::Matrix(int rows, int cols, std::vector<double> &&flat) : rows(rows), cols(cols), data(std::move(flat)) {
+   if (data.size() != (size_t)rows * cols) {
+      throw std::invalid_argument("Incorrect data dimensions!");
+   }
 }
 
+#ifdef __EMSCRIPTEN__
 Matrix::Matrix(emscripten::val v) {
    unsigned int length = v["length"].as<unsigned int>();
    if (length == 0) {
@@ -22,18 +39,18 @@ Matrix::Matrix(emscripten::val v) {
    emscripten::val firstRow = v[0];
    cols = firstRow["length"].as<unsigned int>();
 
-   data.resize(rows);
+   data.resize((size_t)rows * cols);
    for (unsigned int i = 0; i < rows; ++i) {
-      data[i].resize(cols);
       emscripten::val row = v[i];
       if (row["length"].as<unsigned int>() != cols) {
          throw std::invalid_argument("Inconsistent row lengths in JS array");
       }
       for (unsigned int j = 0; j < cols; ++j) {
-         data[i][j] = row[j].as<double>();
+         data[(size_t)i * cols + j] = row[j].as<double>();
       }
    }
 }
+#endif
 
 int Matrix::getRows() const {
    return rows;
@@ -44,7 +61,11 @@ int Matrix::getCols() const {
 }
 
 std::vector<std::vector<double>> Matrix::getData() const {
-   return data;
+   std::vector<std::vector<double>> nested(rows);
+   for (int i = 0; i < rows; i++) {
+      nested[i].assign(data.begin() + (size_t)i * cols, data.begin() + (size_t)(i + 1) * cols);
+   }
+   return nested;
 }
 
 Matrix Matrix::clone() const {
@@ -52,184 +73,270 @@ Matrix Matrix::clone() const {
 }
 
 void Matrix::setData(const std::vector<std::vector<double>> &newData) {
-   data = newData;
-   rows = data.size();
-   cols = (rows > 0) ? data[0].size() : 0;
+   size_t newCols = newData.empty() ? 0 : newData[0].size();
+   for (const std::vector<double> &row : newData) {
+      if (row.size() != newCols)
+         throw std::invalid_argument("Inconsistent row lengths!");
+   }
+   rows = newData.size();
+   cols = newCols;
+   data.resize((size_t)rows * cols);
+   for (int i = 0; i < rows; i++) {
+      std::copy(newData[i].begin(), newData[i].begin() + cols, data.begin() + (size_t)i * cols);
+   }
+}
+
+MatrixView Matrix::view() const {
+   return MatrixView(data.data(), rows, cols, cols);
+}
+
+double *Matrix::values() {
+   return data.data();
+}
+
+const double *Matrix::values() const {
+   return data.data();
+}
+
+void Matrix::resize(int newRows, int newCols) {
+   rows = newRows;
+   cols = newCols;
+   data.resize((size_t)rows * cols);
 }
 
 double &Matrix::at(int i, int j) {
-   return data[i][j];
+   return data[(size_t)i * cols + j];
 }
 
 const double &Matrix::at(int i, int j) const {
-   return data[i][j];
+   return data[(size_t)i * cols + j];
 }
 
 void Matrix::randomWeights() {
-   // Use static generator to avoid re-initialization cost
-   static std::random_device rd;
-   static std::mt19937 gen(rd());
-   std::uniform_real_distribution<> dis(-1.0, 1.0);
-
-   for (int i = 0; i < rows; i++) {
-      for (int j = 0; j < cols; j++) {
-         data[i][j] = dis(gen);
-      }
-   }
+   randomWeights(randomSeed(), 0);
 }
 
 void Matrix::randomWeights(bool round) {
-   static std::random_device rd;
-   static std::mt19937 gen(rd());
-   std::uniform_real_distribution<> dis(-1.0, 1.0);
+   randomWeights(randomSeed(), 0, round);
+}
 
-   for (int i = 0; i < rows; i++) {
-      for (int j = 0; j < cols; j++) {
-         double val = dis(gen);
+void Matrix::randomWeights(uint64_t seed, uint64_t stream, bool round, int numThreads) {
+   CounterRng rng(seed, stream);
+   // Threads only pay off for large matrices
+   if (numThreads <= 0)
+      numThreads = data.size() >= (1 << 16) ? hardwareThreads() : 1;
+
+   parallelFor(data.size(), numThreads, [&](int, int begin, int end) {
+      for (int k = begin; k < end; k++) {
+         double val = rng.uniform(k, -1.0, 1.0);
          if (round) {
             // Round to 1 decimal place like in JS: parseFloat((Math.random() * 2 - 1).toFixed(1))
             val = std::round(val * 10.0) / 10.0;
          }
-         data[i][j] = val;
+         data[k] = val;
       }
-   }
+   });
 }
 
+// Element-wise ops run over the flat storage in one loop.
+
 Matrix Matrix::add(const Matrix &m1, const Matrix &m2) {
-   checkDimensions(m1, m2);
-   Matrix temp(m1.rows, m1.cols);
-   for (int i = 0; i < m1.rows; i++) {
-      for (int j = 0; j < m1.cols; j++) {
-         temp.data[i][j] = m1.data[i][j] + m2.data[i][j];
-      }
-   }
+   Matrix temp = m1;
+   temp.add(m2);
    return temp;
 }
 
 void Matrix::add(const Matrix &m2) {
    checkDimensions(*this, m2);
-   for (int i = 0; i < rows; i++) {
-      for (int j = 0; j < cols; j++) {
-         data[i][j] += m2.data[i][j];
-      }
+   for (size_t i = 0; i < data.size(); i++) {
+      data[i] += m2.data[i];
    }
 }
 
 void Matrix::add(double scalar) {
-   for (int i = 0; i < rows; i++) {
-      for (int j = 0; j < cols; j++) {
-         data[i][j] += scalar;
-      }
+   for (double &v : data) {
+      v += scalar;
    }
 }
 
 Matrix Matrix::subtract(const Matrix &m1, const Matrix &m2) {
-   checkDimensions(m1, m2);
    Matrix temp(m1.rows, m1.cols);
-   for (int i = 0; i < m1.rows; i++) {
-      for (int j = 0; j < m1.cols; j++) {
-         temp.data[i][j] = m1.data[i][j] - m2.data[i][j];
-      }
-   }
+   subtract(m1, m2, temp);
    return temp;
 }
 
+void Matrix::subtract(const Matrix &m1, const Matrix &m2, Matrix &out) {
+   checkDimensions(m1, m2);
+   out.resize(m1.rows, m1.cols);
+   for (size_t i = 0; i < out.data.size(); i++) {
+      out.data[i] = m1.data[i] - m2.data[i];
+   }
+}
+
 void Matrix::subtract(const Matrix &m2) {
    checkDimensions(*this, m2);
-   for (int i = 0; i < rows; i++) {
-      for (int j = 0; j < cols; j++) {
-         data[i][j] -= m2.data[i][j];
-      }
+   for (size_t i = 0; i < data.size(); i++) {
+      data[i] -= m2.data[i];
    }
 }
 
 Matrix Matrix::multiply(const Matrix &m1, const Matrix &m2) {
-   checkDimensions(m1, m2);
    Matrix temp(m1.rows, m1.cols);
-   for (int i = 0; i < m1.rows; i++) {
-      for (int j = 0; j < m1.cols; j++) {
-         temp.data[i][j] = m1.data[i][j] * m2.data[i][j];
-      }
-   }
+   multiply(m1, m2, temp);
    return temp;
 }
 
+void Matrix::multiply(const Matrix &m1, const Matrix &m2, Matrix &out) {
+   checkDimensions(m1, m2);
+   out.resize(m1.rows, m1.cols);
+   for (size_t i = 0; i < out.data.size(); i++) {
+      out.data[i] = m1.data[i] * m2.data[i];
+   }
+}
+
 void Matrix::multiply(const Matrix &m2) {
    checkDimensions(*this, m2);
-   for (int i = 0; i < rows; i++) {
-      for (int j = 0; j < cols; j++) {
-         data[i][j] *= m2.data[i][j];
-      }
+   for (size_t i = 0; i < data.size(); i++) {
+      data[i] *= m2.data[i];
    }
 }
 
 void Matrix::multiply(double scalar) {
-   for (int i = 0; i < rows; i++) {
-      for (int j = 0; j < cols; j++) {
-         data[i][j] *= scalar;
-      }
+   for (double &v : data) {
+      v *= scalar;
    }
 }
 
 Matrix Matrix::dot(const Matrix &m1, const Matrix &m2) {
+   Matrix temp(m1.rows, m2.cols);
+   dot(m1, m2, temp);
+   return temp;
+}
+
+void Matrix::dot(const Matrix &m1, const Matrix &m2, Matrix &out) {
    if (m1.cols != m2.rows) {
       throw std::invalid_argument("Matrixes are not dot compatible!");
    }
-   Matrix temp(m1.rows, m2.cols);
-   for (int i = 0; i < temp.rows; i++) {
-      for (int j = 0; j < temp.cols; j++) {
+   if (&out == &m1 || &out == &m2) {
+      throw std::invalid_argument("Output of dot must not alias an operand!");
+   }
+   out.resize(m1.rows, m2.cols);
+
+   // i-k-j order with the blocking picked per shape and target by the tuner (see gemm.h)
+   GemmTuner::instance().multiply(m1.data.data(), m2.data.data(), out.data.data(), m1.rows, m2.cols, m1.cols);
+}
+
+void Matrix::dotTransA(const Matrix &m1, const Matrix &m2, Matrix &out) {
+   if (m1.rows != m2.rows) {
+      throw std::invalid_argument("Matrixes are not dot compatible!");
+   }
+   if (&out == &m1 || &out == &m2) {
+      throw std::invalid_argument("Output of dot must not alias an operand!");
+   }
+   out.resize(m1.cols, m2.cols);
+   std::fill(out.data.begin(), out.data.end(), 0.0);
+
+   // Sum of outer products of matching rows: out[i][j] += m1[k][i] * m2[k][j]
+   int n = m2.cols;
+   for (int k = 0; k < m1.rows; k++) {
+      const double *m2Row = &m2.data[(size_t)k * n];
+      for (int i = 0; i < m1.cols; i++) {
+         double a = m1.data[(size_t)k * m1.cols + i];
+         if (a == 0.0)
+            continue;
+         double *outRow = &out.data[(size_t)i * n];
+         for (int j = 0; j < n; j++) {
+            outRow[j] += a * m2Row[j];
+         }
+      }
+   }
+}
+
+void Matrix::dotTransB(const Matrix &m1, const Matrix &m2, Matrix &out) {
+   if (m1.cols != m2.cols) {
+      throw std::invalid_argument("Matrixes are not dot compatible!");
+   }
+   if (&out == &m1 || &out == &m2) {
+      throw std::invalid_argument("Output of dot must not alias an operand!");
+   }
+   out.resize(m1.rows, m2.rows);
+
+   // Row-by-row dot products, both operands read contiguously
+   for (int i = 0; i < m1.rows; i++) {
+      const double *m1Row = &m1.data[(size_t)i * m1.cols];
+      for (int j = 0; j < m2.rows; j++) {
+         const double *m2Row = &m2.data[(size_t)j * m2.cols];
          double sum = 0;
          for (int k = 0; k < m1.cols; k++) {
-            sum += m1.data[i][k] * m2.data[k][j];
+            sum += m1Row[k] * m2Row[k];
          }
-         temp.data[i][j] = sum;
+         out.data[(size_t)i * m2.rows + j] = sum;
       }
    }
-   return temp;
 }
 
 Matrix Matrix::convertFromArray(const std::vector<double> &arr) {
-   std::vector<std::vector<double>> d;
-   d.push_back(arr);
-   return Matrix(1, arr.size(), d);
+   return Matrix(1, arr.size(), std::vector<double>(arr));
+}
+
+Matrix Matrix::convertFromArray(std::vector<double> &&arr) {
+   int n = arr.size();
+   return Matrix(1, n, std::move(arr));
 }
 
 Matrix Matrix::map(const Matrix &m1, std::function<double(double)> func) {
    Matrix temp(m1.rows, m1.cols);
-   for (int i = 0; i < m1.rows; i++) {
-      for (int j = 0; j < m1.cols; j++) {
-         temp.data[i][j] = func(m1.data[i][j]);
-      }
+   for (size_t i = 0; i < m1.data.size(); i++) {
+      temp.data[i] = func(m1.data[i]);
    }
    return temp;
 }
 
 void Matrix::map(std::function<double(double)> func) {
-   for (int i = 0; i < rows; i++) {
-      for (int j = 0; j < cols; j++) {
-         data[i][j] = func(data[i][j]);
-      }
+   for (double &v : data) {
+      v = func(v);
    }
 }
 
 Matrix Matrix::transpose(const Matrix &m1) {
    Matrix temp(m1.cols, m1.rows);
+   transpose(m1, temp);
+   return temp;
+}
+
+void Matrix::transpose(const Matrix &m1, Matrix &out) {
+   if (&out == &m1) {
+      out.transpose();
+      return;
+   }
+   out.resize(m1.cols, m1.rows);
    for (int i = 0; i < m1.rows; i++) {
       for (int j = 0; j < m1.cols; j++) {
-         temp.data[j][i] = m1.data[i][j];
+         out.data[(size_t)j * m1.rows + i] = m1.data[(size_t)i * m1.cols + j];
       }
    }
-   return temp;
 }
 
 void Matrix::transpose() {
-   Matrix temp(cols, rows);
-   for (int i = 0; i < rows; i++) {
-      for (int j = 0; j < cols; j++) {
-         temp.data[j][i] = data[i][j];
+   // Vectors (and anything with a single row or column) have the same flat layout either way
+   if (rows > 1 && cols > 1) {
+      if (rows == cols) {
+         for (int i = 0; i < rows; i++) {
+            for (int j = i + 1; j < cols; j++) {
+               std::swap(data[(size_t)i * cols + j], data[(size_t)j * cols + i]);
+            }
+         }
+      } else {
+         std::vector<double> temp(data.size());
+         for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < cols; j++) {
+               temp[(size_t)j * rows + i] = data[(size_t)i * cols + j];
+            }
+         }
+         data.swap(temp);
       }
    }
-   *this = temp;
+   std::swap(rows, cols);
 }
 
 void Matrix::checkDimensions(const Matrix &m1, const Matrix &m2) {
@@ -243,9 +350,9 @@ void Matrix::show() const {
    for (int i = 0; i < rows; i++) {
       for (int j = 0; j < cols; j++) {
          if (j == cols - 1)
-            std::cout << data[i][j];
+            std::cout << at(i, j);
          else
-            std::cout << data[i][j] << " \033[1;34m|\033[0m ";
+            std::cout << at(i, j) << " \033[1;34m|\033[0m ";
       }
       std::cout << std::endl;
    }
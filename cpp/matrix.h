@@ -2,7 +2,10 @@
 #define MATRIX_H
 
 #include <cmath>
+#include <cstdint>
+#ifdef __EMSCRIPTEN__
 #include <emscripten/val.h>
+#endif
 #include <functional>
 #include <iomanip>
 #include <iostream>
@@ -10,50 +13,97 @@
 #include <stdexcept>
 #include <vector>
 
+class Matrix;
+
+// Non-owning, read-only window onto row-major storage (pointer, shape, row stride).
+// Stays valid until the owning Matrix is resized or destroyed.
+class MatrixView {
+private:
+   const double *ptr;
+   int rows;
+   int cols;
+   int stride;
+
+public:
+   MatrixView() : ptr(nullptr), rows(0), cols(0), stride(0) {}
+   MatrixView(const double *ptr, int rows, int cols, int stride) : ptr(ptr), rows(rows), cols(cols), stride(stride) {}
+
+   int getRows() const { return rows; }
+   int getCols() const { return cols; }
+   int getStride() const { return stride; }
+   const double *values() const { return ptr; }
+   const double *row(int i) const { return ptr + (size_t)i * stride; }
+   const double &at(int i, int j) const { return ptr[(size_t)i * stride + j]; }
+
+   Matrix toMatrix() const; // Explicit deep copy
+};
+
 class Matrix {
 private:
    int rows;
    int cols;
-   std::vector<std::vector<double>> data;
+   std::vector<double> data; // Row-major, rows * cols
 
 public:
    Matrix(int rows, int cols);
    Matrix(int rows, int cols, const std::vector<std::vector<double>> &data);
+   Matrix(int rows, int cols, std::vector<double> &&flat); // Takes row-major storage without copying
+#ifdef __EMSCRIPTEN__
    Matrix(emscripten::val data); // Constructor from JS array
+#endif
 
    int getRows() const;
    int getCols() const;
-   std::vector<std::vector<double>> getData() const;
+   std::vector<std::vector<double>> getData() const; // Nested copy for JS; C++ callers should use view()
    void setData(const std::vector<std::vector<double>> &newData);
 
    Matrix clone() const;
 
+   // Zero-copy access to the contiguous row-major storage
+   MatrixView view() const;
+   double *values();
+   const double *values() const;
+
+   // Reshapes to rows x cols, reusing the allocation when it is large enough. Contents are unspecified.
+   void resize(int rows, int cols);
+
    // Access element directly (helper for C++ usage)
    double &at(int i, int j);
    const double &at(int i, int j) const;
 
    void randomWeights();
    void randomWeights(bool round);
+   // Uniform in [-1, 1) from stream `stream` of a counter-based RNG: element k depends only on
+   // (seed, stream, k), so the fill is reproducible and identical for any numThreads (<= 0: all cores).
+   void randomWeights(uint64_t seed, uint64_t stream, bool round = false, int numThreads = 0);
 
    static Matrix add(const Matrix &m1, const Matrix &m2);
    void add(const Matrix &m2);
    void add(double scalar); // Helper often useful
 
    static Matrix subtract(const Matrix &m1, const Matrix &m2);
+   static void subtract(const Matrix &m1, const Matrix &m2, Matrix &out);
    void subtract(const Matrix &m2);
 
    static Matrix multiply(const Matrix &m1, const Matrix &m2); // Element-wise
+   static void multiply(const Matrix &m1, const Matrix &m2, Matrix &out);
    void multiply(const Matrix &m2);                            // Element-wise
    void multiply(double scalar);                               // Helper often useful
 
    static Matrix dot(const Matrix &m1, const Matrix &m2); // Matrix product
+   static void dot(const Matrix &m1, const Matrix &m2, Matrix &out);
+   // m1^T * m2 and m1 * m2^T without materializing the transpose
+   static void dotTransA(const Matrix &m1, const Matrix &m2, Matrix &out);
+   static void dotTransB(const Matrix &m1, const Matrix &m2, Matrix &out);
 
    static Matrix convertFromArray(const std::vector<double> &arr);
+   static Matrix convertFromArray(std::vector<double> &&arr);
 
    static Matrix map(const Matrix &m1, std::function<double(double)> func);
    void map(std::function<double(double)> func);
 
    static Matrix transpose(const Matrix &m1);
+   static void transpose(const Matrix &m1, Matrix &out);
    void transpose();
 
    void show() const;
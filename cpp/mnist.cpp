@@ -0,0 +1,61 @@
+#include "mnist.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+// Reads baseName, or baseName.gz through gzip, like train.js does.
+static std::vector<unsigned char> loadFile(const std::string &baseName) {
+   std::ifstream f(baseName, std::ios::binary);
+   if (f) {
+      return std::vector<unsigned char>(std::istreambuf_iterator<char>(f), {});
+   }
+   std::vector<unsigned char> bytes;
+   std::ifstream gz(baseName + ".gz");
+   if (!gz)
+      return bytes;
+   FILE *p = popen(("gzip -dc '" + baseName + ".gz'").c_str(), "r");
+   if (!p)
+      return bytes;
+   unsigned char buf[1 << 16];
+   size_t n;
+   while ((n = fread(buf, 1, sizeof(buf), p)) > 0) {
+      bytes.insert(bytes.end(), buf, buf + n);
+   }
+   pclose(p);
+   return bytes;
+}
+
+static unsigned int readU32BE(const std::vector<unsigned char> &b, size_t off) {
+   return (b[off] << 24) | (b[off + 1] << 16) | (b[off + 2] << 8) | b[off + 3];
+}
+
+Dataset loadMNIST() {
+   std::vector<unsigned char> images = loadFile("train-images-idx3-ubyte");
+   std::vector<unsigned char> labels = loadFile("train-labels-idx1-ubyte");
+   if (images.size() < 16 || labels.size() < 8) {
+      std::fprintf(stderr, "Error: train-images-idx3-ubyte / train-labels-idx1-ubyte (or .gz) not found\n");
+      std::exit(1);
+   }
+
+   Dataset d;
+   d.count = readU32BE(images, 4);
+   if ((int)readU32BE(labels, 4) != d.count || images.size() < 16 + (size_t)d.count * MNIST_NUM_INP) {
+      std::fprintf(stderr, "Error: image and label files do not match\n");
+      std::exit(1);
+   }
+
+   d.inputs.resize((size_t)d.count * MNIST_NUM_INP);
+   d.targets.assign((size_t)d.count * MNIST_NUM_OUT, 0.0);
+   d.labels.resize(d.count);
+   for (size_t i = 0; i < d.inputs.size(); i++) {
+      d.inputs[i] = images[16 + i] / 255.0;
+   }
+   for (int i = 0; i < d.count; i++) {
+      d.labels[i] = labels[8 + i];
+      d.targets[(size_t)i * MNIST_NUM_OUT + d.labels[i]] = 1.0;
+   }
+   std::printf("Loaded %d images\n", d.count);
+   return d;
+}
@@ -0,0 +1,21 @@
+#ifndef MNIST_H
+#define MNIST_H
+
+#include <vector>
+
+// MNIST training set for the native tools, loaded from the working directory.
+static const int MNIST_NUM_INP = 28 * 28;
+static const int MNIST_NUM_OUT = 10;
+
+struct Dataset {
+   int count = 0;
+   std::vector<double> inputs;  // count * MNIST_NUM_INP, row-major, 0..1
+   std::vector<double> targets; // count * MNIST_NUM_OUT, one-hot
+   std::vector<int> labels;
+};
+
+// Reads train-images-idx3-ubyte / train-labels-idx1-ubyte (or their .gz, like train.js).
+// Exits with a message if they are missing or inconsistent.
+Dataset loadMNIST();
+
+#endif
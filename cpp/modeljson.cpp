@@ -0,0 +1,191 @@
+#include "modeljson.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// Powers of ten that are exact doubles
+static const double POW10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                               1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Eight ASCII digits at a time in one 64-bit register (the targets are little-endian).
+static inline uint64_t load8(const char *p) {
+   uint64_t v;
+   std::memcpy(&v, p, 8);
+   return v;
+}
+
+static inline bool isEightDigits(uint64_t v) {
+   return ((v & 0xF0F0F0F0F0F0F0F0ull) | (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) ==
+          0x3333333333333333ull;
+}
+
+static inline uint32_t eightDigits(uint64_t v) {
+   const uint64_t mask = 0x000000FF000000FFull;
+   v -= 0x3030303030303030ull;
+   v = v * 10 + (v >> 8); // Pairs of digits
+   v = ((v & mask) * 0x000F424000000064ull + ((v >> 16) & mask) * 0x0000271000000001ull) >> 32;
+   return (uint32_t)v;
+}
+
+static inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+bool parseJsonNumber(const char *&p, const char *end, double &out) {
+   const char *start = p;
+   bool negative = p < end && *p == '-';
+   if (negative)
+      p++;
+
+   // Up to 19 significant digits go into mantissa; value = mantissa * 10^exponent.
+   uint64_t mantissa = 0;
+   int exponent = 0;
+   bool exact = true;
+   const char *digits = p;
+   while (p < end && isDigit(*p)) {
+      if (mantissa < 1000000000000000000ull) {
+         mantissa = mantissa * 10 + (*p - '0');
+      } else {
+         exact = false;
+         exponent++;
+      }
+      p++;
+   }
+   if (p == digits)
+      return false;
+   if (p < end && *p == '.') {
+      p++;
+      const char *fraction = p;
+      while (end - p >= 8 && mantissa < 100000000000ull && isEightDigits(load8(p))) {
+         mantissa = mantissa * 100000000 + eightDigits(load8(p));
+         exponent -= 8;
+         p += 8;
+      }
+      while (p < end && isDigit(*p)) {
+         if (mantissa < 1000000000000000000ull) {
+            mantissa = mantissa * 10 + (*p - '0');
+            exponent--;
+         } else if (*p != '0') {
+            exact = false;
+         }
+         p++;
+      }
+      if (p == fraction)
+         return false;
+   }
+   if (p < end && (*p == 'e' || *p == 'E')) {
+      p++;
+      bool negExp = p < end && *p == '-';
+      if (p < end && (*p == '-' || *p == '+'))
+         p++;
+      if (p == end || !isDigit(*p))
+         return false;
+      int e = 0;
+      while (p < end && isDigit(*p)) {
+         e = e < 10000 ? e * 10 + (*p - '0') : e;
+         p++;
+      }
+      exponent += negExp ? -e : e;
+   }
+
+   // Exact mantissa and power of ten: one IEEE multiply or divide rounds correctly.
+   if (exact && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+      double v = (double)mantissa;
+      v = exponent < 0 ? v / POW10[-exponent] : v * POW10[exponent];
+      out = negative ? -v : v;
+      return true;
+   }
+   // 17-digit and extreme values; the text is NUL-terminated (std::string)
+   char *stop;
+   out = std::strtod(start, &stop);
+   return stop == p;
+}
+
+static void skipSpace(const char *&p, const char *end) {
+   while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+      p++;
+}
+
+// [[a, b, ...], [c, d, ...], ...] into a rows x cols matrix
+static bool parseMatrix(const char *&p, const char *end, Matrix &out) {
+   std::vector<double> data;
+   int rows = 0, cols = -1;
+   skipSpace(p, end);
+   if (p == end || *p++ != '[')
+      return false;
+   skipSpace(p, end);
+   if (p < end && *p == ']') {
+      out = Matrix(0, 0);
+      return true;
+   }
+   while (true) {
+      skipSpace(p, end);
+      if (p == end || *p++ != '[')
+         return false;
+      int count = 0;
+      skipSpace(p, end);
+      if (p < end && *p != ']') {
+         while (true) {
+            double v;
+            if (!parseJsonNumber(p, end, v))
+               return false;
+            data.push_back(v);
+            count++;
+            skipSpace(p, end);
+            if (p < end && *p == ',') {
+               p++;
+               skipSpace(p, end);
+               continue;
+            }
+            break;
+         }
+      }
+      if (p == end || *p++ != ']')
+         return false;
+      if (cols < 0) {
+         cols = count;
+         data.reserve((size_t)cols * 64);
+      } else if (count != cols) {
+         return false; // Ragged
+      }
+      rows++;
+      skipSpace(p, end);
+      if (p < end && *p == ',') {
+         p++;
+         continue;
+      }
+      if (p == end || *p++ != ']')
+         return false;
+      break;
+   }
+   out = Matrix(rows, cols, std::move(data));
+   return true;
+}
+
+// 1 = parsed, 0 = key missing, -1 = malformed
+static int parseEntry(const std::string &text, const std::string &key, Matrix &out) {
+   size_t at = text.find("\"" + key + "\"");
+   if (at == std::string::npos)
+      return 0;
+   const char *p = text.data() + at + key.size() + 2;
+   const char *end = text.data() + text.size();
+   skipSpace(p, end);
+   if (p == end || *p++ != ':')
+      return -1;
+   return parseMatrix(p, end, out) ? 1 : -1;
+}
+
+bool parseModelJson(const std::string &text, std::vector<Matrix> &weights, std::vector<Matrix> &biases) {
+   weights.clear();
+   biases.clear();
+   for (int i = 0;; i++) {
+      Matrix w(0, 0), b(0, 0);
+      int hasW = parseEntry(text, "weights" + std::to_string(i), w);
+      int hasB = parseEntry(text, "bias" + std::to_string(i), b);
+      if (hasW < 0 || hasB < 0)
+         return false;
+      if (hasW == 0 || hasB == 0)
+         break;
+      weights.push_back(std::move(w));
+      biases.push_back(std::move(b));
+   }
+   return !weights.empty();
+}
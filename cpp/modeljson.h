@@ -0,0 +1,16 @@
+#ifndef MODELJSON_H
+#define MODELJSON_H
+
+#include "matrix.h"
+#include <string>
+#include <vector>
+
+// Reads the bias{i} and weights{i} arrays of a model.json written by train.js or the Save
+// button, for i = 0, 1, ... until one is missing. Numbers go straight from the text into
+// flat matrix storage. Returns false if no layer is found or an array is malformed.
+bool parseModelJson(const std::string &text, std::vector<Matrix> &weights, std::vector<Matrix> &biases);
+
+// Parses one JSON number at p (correctly rounded) and advances p past it.
+bool parseJsonNumber(const char *&p, const char *end, double &out);
+
+#endif
@@ -1,7 +1,17 @@
 #include "nn.h"
+#include "gemm.h"
+#include "modeljson.h"
+#include "parallel.h"
+#include "rng.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
 
 NeuralNetwork::NeuralNetwork(int numInp, std::vector<int> hiddenSizes, int numOut, double lrnRate)
-    : lrnRate(lrnRate), lrStep(0) {
+    : NeuralNetwork(numInp, hiddenSizes, numOut, lrnRate, (unsigned int)randomSeed()) {}
+
+NeuralNetwork::NeuralNetwork(int numInp, std::vector<int> hiddenSizes, int numOut, double lrnRate, unsigned int seed)
+    : lrnRate(lrnRate), lrStep(lrnRate) {
 
    layerSizes.push_back(numInp);
    for (int size : hiddenSizes) {
@@ -22,39 +32,95 @@ NeuralNetwork::NeuralNetwork(int numInp, std::vector<int> hiddenSizes, int numOu
 
    // Initialize weights and biases
    for (int i = 0; i < numLayers - 1; i++) {
-      int inSize = layerSizes[i];
-      int outSize = layerSizes[i + 1];
-
-      Matrix w(inSize, outSize);
-      w.randomWeights();
-      weights.push_back(w);
-
-      Matrix b(1, outSize);
-      b.randomWeights();
-      biases.push_back(b);
+      weights.push_back(Matrix(layerSizes[i], layerSizes[i + 1]));
+      biases.push_back(Matrix(1, layerSizes[i + 1]));
    }
+   reseed(seed);
 
    // Resize errors and deltas
    errors.resize(numLayers, Matrix(0, 0));
    deltas.resize(numLayers, Matrix(0, 0));
 }
 
+void NeuralNetwork::reseed(unsigned int newSeed) {
+   weightsChanged();
+   // Weights of layer i use RNG stream 2i, biases stream 2i + 1
+   seed = newSeed;
+   for (int i = 0; i < numLayers - 1; i++) {
+      weights[i].randomWeights(seed, 2 * i);
+      biases[i].randomWeights(seed, 2 * i + 1);
+   }
+   pruneMasks.clear();
+}
+
+unsigned int NeuralNetwork::getSeed() const { return seed; }
+
+void NeuralNetwork::weightsChanged() {
+   // Process-wide, so copies of a network never reuse a version for different weights
+   static std::atomic<uint64_t> counter(0);
+   weightsVersion = ++counter;
+}
+
+uint64_t NeuralNetwork::getWeightsVersion() const { return weightsVersion; }
+
+void NeuralNetwork::setInferenceCache(int capacity, int levels) {
+   inferenceCache = std::make_shared<InferenceCache>(capacity, levels);
+}
+
+void NeuralNetwork::clearInferenceCache() { inferenceCache.reset(); }
+
+CacheStats NeuralNetwork::getInferenceCacheStats() const {
+   return inferenceCache ? inferenceCache->getStats() : CacheStats();
+}
+
+void NeuralNetwork::forwardLayer(const MatrixView &a, const Matrix &w, const Matrix &b, Matrix &out) {
+   // z = a * W + b, then a' = sigmoid(z), written straight into out
+   out.resize(a.getRows(), w.getCols());
+   GemmTuner::instance().multiply(a.values(), w.values(), out.values(), a.getRows(), w.getCols(), a.getCols());
+   int cols = out.getCols();
+   const double *bias = b.values();
+   for (int r = 0; r < out.getRows(); r++) {
+      double *row = out.values() + (size_t)r * cols;
+      for (int j = 0; j < cols; j++) {
+         row[j] = 1.0 / (1.0 + std::exp(-(row[j] + bias[j])));
+      }
+   }
+}
+
 Matrix NeuralNetwork::feedForward(const Matrix &input) {
    // Input layer
    // If input is 1D (1 row), good.
    layers[0] = input;
 
-   for (int i = 0; i < numLayers - 1; i++) {
-      // z = a[i] * W[i] + b[i]
-      Matrix z = Matrix::dot(layers[i], weights[i]);
-      z.add(biases[i]);
-
-      // a[i+1] = sigmoid(z)
-      z.map([](double x) { return 1.0 / (1.0 + std::exp(-x)); });
+   InferenceCache::Key key;
+   bool cached = inferenceCache && input.getCols() == layerSizes[0];
+   if (cached) {
+      // A hit restores every layer's activations, so visualizations see the same state
+      key = inferenceCache->makeKey(input.values(), (size_t)input.getRows() * input.getCols());
+      if (inferenceCache->lookup(key, weightsVersion, cachedActivations)) {
+         const double *p = cachedActivations.data();
+         for (int i = 1; i < numLayers; i++) {
+            layers[i].resize(input.getRows(), layerSizes[i]);
+            size_t n = (size_t)input.getRows() * layerSizes[i];
+            std::copy_n(p, n, layers[i].values());
+            p += n;
+         }
+         return layers[numLayers - 1];
+      }
+   }
 
-      layers[i + 1] = z;
+   for (int i = 0; i < numLayers - 1; i++) {
+      forwardLayer(layers[i].view(), weights[i], biases[i], layers[i + 1]);
    }
 
+   if (cached) {
+      cachedActivations.clear();
+      for (int i = 1; i < numLayers; i++) {
+         cachedActivations.insert(cachedActivations.end(), layers[i].values(),
+                                  layers[i].values() + (size_t)layers[i].getRows() * layers[i].getCols());
+      }
+      inferenceCache->insert(std::move(key), weightsVersion, cachedActivations);
+   }
    return layers[numLayers - 1];
 }
 
@@ -63,49 +129,140 @@ Matrix NeuralNetwork::feedForwardArray(const std::vector<double> &input) {
    return feedForward(m);
 }
 
-void NeuralNetwork::train(const Matrix &input, const Matrix &target) {
+std::vector<double> NeuralNetwork::predictBatch(const std::vector<double> &inputs, int batchSize) const {
+   int inputSize = layerSizes[0];
+   if (batchSize <= 0 || inputs.size() < (size_t)batchSize * inputSize)
+      return {};
+   return predictRows(MatrixView(inputs.data(), batchSize, inputSize, inputSize));
+}
+
+std::vector<double> NeuralNetwork::predictBatch(const Tensor &inputs) const {
+   MatrixView in = inputs.asMatrix();
+   if (in.getCols() != layerSizes[0]) {
+      throw std::invalid_argument("Tensor rows do not match the input size!");
+   }
+   if (in.getRows() == 0)
+      return {};
+   return predictRows(in);
+}
+
+std::vector<double> NeuralNetwork::predictRows(const MatrixView &inputs) const {
+   int batchSize = inputs.getRows();
+   int inputSize = layerSizes[0];
+   int outputSize = layerSizes[numLayers - 1];
+
+   // One (batch x in) * (in x out) product per layer instead of batchSize row products.
+   Matrix a(batchSize, inputSize);
+   for (int r = 0; r < batchSize; r++) {
+      std::copy_n(inputs.row(r), inputSize, a.values() + (size_t)r * inputSize);
+   }
+   Matrix z(0, 0);
+   for (int i = 0; i < numLayers - 1; i++) {
+      forwardLayer(a.view(), weights[i], biases[i], z);
+      std::swap(a, z);
+   }
+
+   return std::vector<double>(a.values(), a.values() + (size_t)batchSize * outputSize);
+}
+
+void NeuralNetwork::backprop(const MatrixView &input, const MatrixView &target, std::vector<Matrix> &acts,
+                             std::vector<Matrix> &errs, std::vector<Matrix> &dlts) const {
    // 1. Forward pass
-   Matrix outputs = feedForward(input);
+   forwardLayer(input, weights[0], biases[0], acts[1]);
+   for (int i = 1; i < numLayers - 1; i++) {
+      forwardLayer(acts[i].view(), weights[i], biases[i], acts[i + 1]);
+   }
 
    int L = numLayers - 1;
 
    // 2. Output error = target - output
-   errors[L] = Matrix::subtract(target, outputs);
-
-   // 3. Output delta
-   // derivative of sigmoid(output) = output * (1 - output)
-   Matrix outputDerivs = outputs; // Copy
-   outputDerivs.map([](double x) { return x * (1.0 - x); });
+   int outSize = layerSizes[L];
+   errs[L].resize(input.getRows(), outSize);
+   for (int r = 0; r < input.getRows(); r++) {
+      const double *t = target.row(r);
+      const double *a = acts[L].values() + (size_t)r * outSize;
+      double *e = errs[L].values() + (size_t)r * outSize;
+      for (int j = 0; j < outSize; j++) {
+         e[j] = t[j] - a[j];
+      }
+   }
 
-   deltas[L] = Matrix::multiply(errors[L], outputDerivs);
+   // 3. Deltas: error * sigmoid'(z), where sigmoid' = output * (1 - output).
+   //    error[i] = delta[i+1] * W[i]^T for the hidden layers.
+   for (int i = L; i > 0; i--) {
+      if (i < L) {
+         Matrix::dotTransB(dlts[i + 1], weights[i], errs[i]);
+      }
+      dlts[i].resize(errs[i].getRows(), errs[i].getCols());
+      const double *e = errs[i].values();
+      const double *a = acts[i].values();
+      double *d = dlts[i].values();
+      size_t n = (size_t)errs[i].getRows() * errs[i].getCols();
+      for (size_t k = 0; k < n; k++) {
+         d[k] = e[k] * a[k] * (1.0 - a[k]);
+      }
+   }
+}
 
-   // 4. Backprop
-   for (int i = L - 1; i > 0; i--) {
-      // error[i] = delta[i+1] * W[i]^T
-      Matrix wT = Matrix::transpose(weights[i]);
-      errors[i] = Matrix::dot(deltas[i + 1], wT);
+// w += scale * a^T * d and bias += scale * sum of d rows, accumulated row by row in place,
+// so no gradient matrix is ever allocated.
+static void accumulateDeltas(const MatrixView &a, const Matrix &d, double scale, double *w, double *bias) {
+   int in = a.getCols();
+   int out = d.getCols();
+   for (int r = 0; r < a.getRows(); r++) {
+      const double *aRow = a.row(r);
+      const double *dRow = d.values() + (size_t)r * out;
+      for (int k = 0; k < in; k++) {
+         double s = aRow[k] * scale;
+         if (s == 0.0)
+            continue; // Blank pixels contribute nothing
+         double *wRow = w + (size_t)k * out;
+         for (int j = 0; j < out; j++) {
+            wRow[j] += s * dRow[j];
+         }
+      }
+      for (int j = 0; j < out; j++) {
+         bias[j] += scale * dRow[j];
+      }
+   }
+}
 
-      // delta[i]
-      Matrix layerI = layers[i];
-      Matrix derivs = layerI; // Copy
-      derivs.map([](double x) { return x * (1.0 - x); });
+void NeuralNetwork::applyPruneMasks() {
+   for (int i = 0; i < numLayers - 1; i++) {
+      applyPruneMask(i);
+   }
+}
 
-      deltas[i] = Matrix::multiply(errors[i], derivs);
+void NeuralNetwork::applyPruneMask(int layer) {
+   if (pruneMasks.empty())
+      return;
+   double *w = weights[layer].values();
+   const uint8_t *mask = pruneMasks[layer].data();
+   size_t n = pruneMasks[layer].size();
+   for (size_t k = 0; k < n; k++) {
+      w[k] = mask[k] ? 0.0 : w[k];
    }
+}
 
-   // 5. Update weights & biases
+void NeuralNetwork::applyDeltas(const MatrixView &input, const std::vector<Matrix> &acts,
+                                const std::vector<Matrix> &dlts, double scale) {
+   // W[i] += scale * a[i]^T * delta[i+1], b[i] += scale * sum of delta[i+1] rows.
    for (int i = 0; i < numLayers - 1; i++) {
-      Matrix aT = Matrix::transpose(layers[i]);
-      Matrix weightDeltas = Matrix::dot(aT, deltas[i + 1]);
+      accumulateDeltas(i == 0 ? input : acts[i].view(), dlts[i + 1], scale, weights[i].values(), biases[i].values());
+   }
+   applyPruneMasks();
+}
 
-      weightDeltas.multiply(lrnRate);
-      weights[i].add(weightDeltas);
+void NeuralNetwork::sgdStep(const Matrix &input, const Matrix &target, std::vector<Matrix> &acts,
+                            std::vector<Matrix> &errs, std::vector<Matrix> &dlts) {
+   backprop(input.view(), target.view(), acts, errs, dlts);
+   applyDeltas(input.view(), acts, dlts, lrnRate);
+}
 
-      // Update biases
-      Matrix biasDeltas = deltas[i + 1]; // Copy
-      biasDeltas.multiply(lrnRate);
-      biases[i].add(biasDeltas);
-   }
+void NeuralNetwork::train(const Matrix &input, const Matrix &target) {
+   weightsChanged();
+   layers[0] = input; // Visualizations read the input layer
+   sgdStep(input, target, layers, errors, deltas);
 }
 
 void NeuralNetwork::trainArray(const std::vector<double> &input, const std::vector<double> &target) {
@@ -115,102 +272,323 @@ void NeuralNetwork::trainArray(const std::vector<double> &input, const std::vect
 }
 
 void NeuralNetwork::trainBatch(const std::vector<double> &inputs, const std::vector<double> &targets, int batchSize) {
+   weightsChanged();
    if (batchSize <= 0)
       return;
 
    int inputSize = layerSizes[0];
    int outputSize = layerSizes[numLayers - 1];
+   trainRows(MatrixView(inputs.data(), batchSize, inputSize, inputSize),
+             MatrixView(targets.data(), batchSize, outputSize, outputSize));
+}
 
-   // Initialize accumulators for gradients
-   std::vector<Matrix> weightGradients;
-   std::vector<Matrix> biasGradients;
-
-   for (int i = 0; i < numLayers - 1; i++) {
-      weightGradients.push_back(Matrix(weights[i].getRows(), weights[i].getCols())); // Init with 0
-      biasGradients.push_back(Matrix(biases[i].getRows(), biases[i].getCols()));     // Init with 0
+void NeuralNetwork::trainBatch(const Tensor &inputs, const Tensor &targets) {
+   weightsChanged();
+   MatrixView in = inputs.asMatrix();
+   MatrixView tgt = targets.asMatrix();
+   if (in.getCols() != layerSizes[0] || tgt.getCols() != layerSizes[numLayers - 1] || in.getRows() != tgt.getRows()) {
+      throw std::invalid_argument("Tensor shapes do not match the network!");
    }
+   if (in.getRows() == 0)
+      return;
 
-   for (int b = 0; b < batchSize; b++) {
-      // Extract single input and target
-      std::vector<double> inputVec(inputs.begin() + b * inputSize, inputs.begin() + (b + 1) * inputSize);
-      std::vector<double> targetVec(targets.begin() + b * outputSize, targets.begin() + (b + 1) * outputSize);
+   trainRows(in, tgt);
+}
 
-      Matrix input = Matrix::convertFromArray(inputVec);
-      Matrix target = Matrix::convertFromArray(targetVec);
+void NeuralNetwork::trainRows(const MatrixView &inputs, const MatrixView &targets) {
+   // The whole batch goes through each layer as one (batch x in) matrix product;
+   // the per-row deltas then sum into the weights, averaged over the batch.
+   MatrixView in = stageBatch(inputs);
+   backprop(in, targets, layers, errors, deltas);
+   applyDeltas(in, layers, deltas, lrnRate / in.getRows());
+}
 
-      // --- Forward Pass ---
-      layers[0] = input;
-      for (int i = 0; i < numLayers - 1; i++) {
-         Matrix z = Matrix::dot(layers[i], weights[i]);
-         z.add(biases[i]);
-         z.map([](double x) { return 1.0 / (1.0 + std::exp(-x)); });
-         layers[i + 1] = z;
-      }
-      Matrix outputs = layers[numLayers - 1];
+MatrixView NeuralNetwork::stageBatch(const MatrixView &inputs) {
+   if (!augmenter && inputs.getStride() == inputs.getCols())
+      return inputs;
 
-      // --- Backprop ---
-      int L = numLayers - 1;
+   int batchSize = inputs.getRows();
+   int inputSize = layerSizes[0];
+   batchInput.resize(batchSize, inputSize);
+   for (int r = 0; r < batchSize; r++) {
+      double *row = batchInput.values() + (size_t)r * inputSize;
+      if (augmenter) {
+         augmenter->augment(inputs.row(r), row);
+      } else {
+         std::copy_n(inputs.row(r), inputSize, row);
+      }
+   }
+   stagedBytes += (uint64_t)batchSize * inputSize * sizeof(double);
+   return batchInput.view();
+}
 
-      // Output error
-      errors[L] = Matrix::subtract(target, outputs);
+uint64_t NeuralNetwork::getStagedBytes() const { return stagedBytes; }
 
-      // Output delta
-      Matrix outputDerivs = outputs;
-      outputDerivs.map([](double x) { return x * (1.0 - x); });
-      deltas[L] = Matrix::multiply(errors[L], outputDerivs);
+void NeuralNetwork::computeUpdate(const std::vector<double> &inputs, const std::vector<double> &targets, int batchSize,
+                                  std::vector<double> &update) {
+   update.assign(getParameterCount(), 0.0);
+   if (batchSize <= 0)
+      return;
 
-      // Hidden deltas
-      for (int i = L - 1; i > 0; i--) {
-         Matrix wT = Matrix::transpose(weights[i]);
-         errors[i] = Matrix::dot(deltas[i + 1], wT);
+   int inputSize = layerSizes[0];
+   int outputSize = layerSizes[numLayers - 1];
+   MatrixView in = stageBatch(MatrixView(inputs.data(), batchSize, inputSize, inputSize));
+   backprop(in, MatrixView(targets.data(), batchSize, outputSize, outputSize), layers, errors, deltas);
+   double *p = update.data();
+   for (int i = 0; i < numLayers - 1; i++) {
+      size_t wSize = (size_t)layerSizes[i] * layerSizes[i + 1];
+      accumulateDeltas(i == 0 ? in : layers[i].view(), deltas[i + 1], lrnRate / batchSize, p, p + wSize);
+      p += wSize + layerSizes[i + 1];
+   }
+}
 
-         Matrix layerI = layers[i];
-         Matrix derivs = layerI;
-         derivs.map([](double x) { return x * (1.0 - x); });
-         deltas[i] = Matrix::multiply(errors[i], derivs);
+void NeuralNetwork::applyUpdate(const std::vector<double> &update) {
+   weightsChanged();
+   if (update.size() != (size_t)getParameterCount()) {
+      throw std::invalid_argument("Update does not match the parameter count!");
+   }
+   const double *p = update.data();
+   for (int i = 0; i < numLayers - 1; i++) {
+      for (Matrix *m : {&weights[i], &biases[i]}) {
+         double *v = m->values();
+         size_t n = (size_t)m->getRows() * m->getCols();
+         for (size_t k = 0; k < n; k++) {
+            v[k] += p[k];
+         }
+         p += n;
       }
+   }
+   applyPruneMasks();
+}
 
-      // --- Accumulate Gradients ---
-      for (int i = 0; i < numLayers - 1; i++) {
-         Matrix aT = Matrix::transpose(layers[i]);
-         Matrix weightDelta = Matrix::dot(aT, deltas[i + 1]);
+int NeuralNetwork::getParameterCount() const {
+   int n = 0;
+   for (int i = 0; i < numLayers - 1; i++) {
+      n += (layerSizes[i] + 1) * layerSizes[i + 1];
+   }
+   return n;
+}
 
-         weightGradients[i].add(weightDelta);
-         biasGradients[i].add(deltas[i + 1]);
+void NeuralNetwork::getParameters(std::vector<double> &out) const {
+   out.resize(getParameterCount());
+   double *p = out.data();
+   for (int i = 0; i < numLayers - 1; i++) {
+      for (const Matrix *m : {&weights[i], &biases[i]}) {
+         size_t n = (size_t)m->getRows() * m->getCols();
+         std::copy_n(m->values(), n, p);
+         p += n;
       }
    }
+}
 
-   // --- Apply Gradients ---
-   double scalar = lrnRate / batchSize;
-
+void NeuralNetwork::setParameters(const std::vector<double> &params) {
+   weightsChanged();
+   if (params.size() != (size_t)getParameterCount()) {
+      throw std::invalid_argument("Parameters do not match the parameter count!");
+   }
+   const double *p = params.data();
    for (int i = 0; i < numLayers - 1; i++) {
-      weightGradients[i].multiply(scalar);
-      biasGradients[i].multiply(scalar);
+      for (Matrix *m : {&weights[i], &biases[i]}) {
+         size_t n = (size_t)m->getRows() * m->getCols();
+         std::copy_n(p, n, m->values());
+         p += n;
+      }
+   }
+   applyPruneMasks();
+}
+
+void NeuralNetwork::setAugmentation(const AugmentConfig &config, unsigned int seed) {
+   int side = std::lround(std::sqrt(layerSizes[0]));
+   if (side * side != layerSizes[0]) {
+      throw std::invalid_argument("Augmentation needs square image inputs!");
+   }
+   augmenter = std::make_shared<Augmenter>(side, side, seed, config);
+}
+
+void NeuralNetwork::clearAugmentation() { augmenter.reset(); }
+
+void NeuralNetwork::trainHogwild(const std::vector<double> &inputs, const std::vector<double> &targets, int count,
+                                 int numThreads) {
+   weightsChanged();
+   if (count <= 0)
+      return;
+
+   int inputSize = layerSizes[0];
+   int outputSize = layerSizes[numLayers - 1];
+   if (numThreads <= 0)
+      numThreads = hardwareThreads();
+
+   // Every shard runs plain per-sample SGD against the shared weights and biases.
+   // Updates are lock-free: concurrent read-modify-writes on the same element may
+   // drop a contribution, which Hogwild tolerates because MNIST gradients are sparse
+   // (blank border pixels never touch their weight rows).
+   parallelFor(count, numThreads, [&](int, int begin, int end) {
+      std::vector<Matrix> acts(numLayers, Matrix(0, 0));
+      std::vector<Matrix> errs(numLayers, Matrix(0, 0));
+      std::vector<Matrix> dlts(numLayers, Matrix(0, 0));
+      Matrix input(1, inputSize);
+      Matrix target(1, outputSize);
+
+      for (int b = begin; b < end; b++) {
+         std::copy_n(inputs.begin() + (size_t)b * inputSize, inputSize, input.values());
+         std::copy_n(targets.begin() + (size_t)b * outputSize, outputSize, target.values());
+         sgdStep(input, target, acts, errs, dlts);
+      }
+   });
+}
+
+void NeuralNetwork::trainPipelined(const std::vector<double> &inputs, const std::vector<double> &targets, int count,
+                                   const PipelineConfig &config) {
+   weightsChanged();
+   if (count <= 0)
+      return;
+
+   int inputSize = layerSizes[0];
+   int outputSize = layerSizes[numLayers - 1];
+   int batchSize = std::max(1, config.batchSize);
+   int total = (count + batchSize - 1) / batchSize;
+
+#if !NN_HAS_THREADS
+   for (int b = 0; b < count; b += batchSize) {
+      int rows = std::min(batchSize, count - b);
+      trainRows(MatrixView(inputs.data() + (size_t)b * inputSize, rows, inputSize, inputSize),
+                MatrixView(targets.data() + (size_t)b * outputSize, rows, outputSize, outputSize));
+   }
+#else
+
+   // Stage i owns weights[i] and biases[i]: it runs that layer's forward pass and, when the
+   // deltas come back, its error propagation and weight update. A microbatch lives in slot
+   // id % window until stage 0 has applied its update, which is also what frees the window.
+   int stages = numLayers - 1;
+   int window = config.maxInFlight > 0 ? config.maxInFlight : stages;
+   struct Slot {
+      int id = 0;
+      int rows = 0;
+      std::vector<Matrix> acts, dlts, stash;
+   };
+   std::vector<Slot> slots(window);
+   for (Slot &slot : slots) {
+      slot.acts.assign(numLayers, Matrix(0, 0));
+      slot.dlts.assign(numLayers, Matrix(0, 0));
+      slot.stash.assign(stages, Matrix(0, 0));
+   }
+   // forward[i] carries slots from stage i - 1 to stage i, backward[i] from stage i + 1 to stage i.
+   std::vector<std::unique_ptr<SpscQueue<int>>> forward, backward;
+   for (int i = 0; i < stages; i++) {
+      forward.emplace_back(new SpscQueue<int>(window));
+      backward.emplace_back(new SpscQueue<int>(window));
+   }
+   auto send = [](SpscQueue<int> &queue, int s) {
+      while (!queue.push(s))
+         std::this_thread::yield();
+   };
+
+   auto backwardStep = [&](int i, Slot &m, Matrix &err) {
+      // Errors for the layer below go through the weights before this update: the ones the
+      // forward pass used if stashed, otherwise the current ones.
+      if (i > 0) {
+         Matrix::dotTransB(m.dlts[i + 1], config.stashWeights ? m.stash[i] : weights[i], err);
+         m.dlts[i].resize(err.getRows(), err.getCols());
+         const double *e = err.values();
+         const double *a = m.acts[i].values();
+         double *d = m.dlts[i].values();
+         size_t n = (size_t)err.getRows() * err.getCols();
+         for (size_t k = 0; k < n; k++) {
+            d[k] = e[k] * a[k] * (1.0 - a[k]);
+         }
+      }
+      accumulateDeltas(m.acts[i].view(), m.dlts[i + 1], lrnRate / m.rows, weights[i].values(), biases[i].values());
+      applyPruneMask(i);
+   };
+
+   auto runStage = [&](int i) {
+      Matrix err(0, 0);
+      int injected = 0, done = 0;
+      while (done < total) {
+         int s;
+         // Backward work first: it applies updates sooner and frees the window.
+         if (backward[i]->pop(s)) {
+            backwardStep(i, slots[s], err);
+            if (i > 0)
+               send(*backward[i - 1], s);
+            done++;
+            continue;
+         }
+         if (i == 0 && injected < total && injected - done < window) {
+            s = injected % window;
+            Slot &m = slots[s];
+            m.id = injected++;
+            m.rows = std::min(batchSize, count - m.id * batchSize);
+            m.acts[0].resize(m.rows, inputSize);
+            for (int r = 0; r < m.rows; r++) {
+               const double *in = inputs.data() + ((size_t)m.id * batchSize + r) * inputSize;
+               double *row = m.acts[0].values() + (size_t)r * inputSize;
+               if (augmenter) {
+                  augmenter->augment(in, row);
+               } else {
+                  std::copy_n(in, inputSize, row);
+               }
+            }
+         } else if (i == 0 || !forward[i]->pop(s)) {
+            std::this_thread::yield();
+            continue;
+         }
+
+         Slot &m = slots[s];
+         if (config.stashWeights && i > 0)
+            m.stash[i] = weights[i];
+         forwardLayer(m.acts[i].view(), weights[i], biases[i], m.acts[i + 1]);
+         if (i < stages - 1) {
+            send(*forward[i + 1], s);
+            continue;
+         }
+
+         // Last stage: output deltas (target - output) * sigmoid', then straight into backward.
+         m.dlts[stages].resize(m.rows, outputSize);
+         const double *t = targets.data() + (size_t)m.id * batchSize * outputSize;
+         const double *a = m.acts[stages].values();
+         double *d = m.dlts[stages].values();
+         for (size_t k = 0; k < (size_t)m.rows * outputSize; k++) {
+            double e = t[k] - a[k];
+            d[k] = e * a[k] * (1.0 - a[k]);
+         }
+         backwardStep(i, m, err);
+         if (i > 0)
+            send(*backward[i - 1], s);
+         done++;
+      }
+   };
 
-      weights[i].add(weightGradients[i]);
-      biases[i].add(biasGradients[i]);
+   std::vector<std::thread> workers;
+   for (int i = 1; i < stages; i++) {
+      workers.emplace_back(runStage, i);
+   }
+   runStage(0);
+   for (auto &w : workers) {
+      w.join();
    }
+#endif
 }
 
 int NeuralNetwork::getNumLayers() const { return numLayers; }
 
-Matrix NeuralNetwork::getLayer(int index) const {
+MatrixView NeuralNetwork::getLayer(int index) const {
    if (index < 0 || index >= numLayers)
-      return Matrix(0, 0);
-   return layers[index];
+      return MatrixView();
+   return layers[index].view();
 }
 
-Matrix NeuralNetwork::getWeights(int index) const {
+MatrixView NeuralNetwork::getWeights(int index) const {
    if (index < 0 || index >= weights.size())
-      return Matrix(0, 0);
-   return weights[index];
+      return MatrixView();
+   return weights[index].view();
 }
 
-Matrix NeuralNetwork::getBiases(int index) const {
+MatrixView NeuralNetwork::getBiases(int index) const {
    if (index >= 0 && index < numLayers - 1) {
-      return biases[index];
+      return biases[index].view();
    }
-   return Matrix(0, 0);
+   return MatrixView();
 }
 
 double NeuralNetwork::getNeuronVal(int layerIdx, int neuronIdx) const {
@@ -248,14 +626,113 @@ void NeuralNetwork::setLrnRate(double rate) { lrnRate = rate; }
 double NeuralNetwork::getLrStep() const { return lrStep; }
 void NeuralNetwork::setLrStep(double step) { lrStep = step; }
 
+bool NeuralNetwork::loadModelJson(const std::string &text) {
+   std::vector<Matrix> w, b;
+   if (!parseModelJson(text, w, b) || (int)w.size() != numLayers - 1)
+      return false;
+   for (int i = 0; i < numLayers - 1; i++) {
+      if (w[i].getRows() != layerSizes[i] || w[i].getCols() != layerSizes[i + 1] || b[i].getRows() != 1 ||
+          b[i].getCols() != layerSizes[i + 1])
+         return false;
+   }
+   weightsChanged();
+   weights = std::move(w);
+   biases = std::move(b);
+   pruneMasks.clear();
+   return true;
+}
+
 void NeuralNetwork::setWeights(int index, const Matrix &w) {
+   weightsChanged();
    if (index >= 0 && index < weights.size()) {
       weights[index] = w;
+      pruneMasks.clear();
    }
 }
 
 void NeuralNetwork::setBiases(int index, const Matrix &b) {
+   weightsChanged();
    if (index >= 0 && index < biases.size()) {
       biases[index] = b;
    }
 }
+
+void NeuralNetwork::snapshot(Checkpoint &out) const {
+   out.layerSizes = layerSizes;
+   out.lrnRate = lrnRate;
+   out.lrStep = lrStep;
+   out.augmentPosition = augmenter ? augmenter->position() : 0;
+   out.weights.resize(numLayers - 1);
+   out.biases.resize(numLayers - 1);
+
+   for (int i = 0; i < numLayers - 1; i++) {
+      size_t n = (size_t)weights[i].getRows() * weights[i].getCols();
+      out.weights[i].assign(weights[i].values(), weights[i].values() + n);
+      out.biases[i].assign(biases[i].values(), biases[i].values() + biases[i].getCols());
+   }
+}
+
+bool NeuralNetwork::restore(const Checkpoint &ckpt) {
+   weightsChanged();
+   if (ckpt.layerSizes != layerSizes)
+      return false;
+
+   for (int i = 0; i < numLayers - 1; i++) {
+      weights[i].resize(layerSizes[i], layerSizes[i + 1]);
+      biases[i].resize(1, layerSizes[i + 1]);
+      std::copy(ckpt.weights[i].begin(), ckpt.weights[i].end(), weights[i].values());
+      std::copy(ckpt.biases[i].begin(), ckpt.biases[i].end(), biases[i].values());
+   }
+   lrnRate = ckpt.lrnRate;
+   lrStep = ckpt.lrStep;
+   if (augmenter) {
+      augmenter->seek(ckpt.augmentPosition);
+   }
+   pruneMasks.clear();
+   return true;
+}
+
+double NeuralNetwork::prune(double sparsity) {
+   weightsChanged();
+   sparsity = std::min(1.0, std::max(0.0, sparsity));
+   pruneMasks.resize(numLayers - 1);
+
+   for (int i = 0; i < numLayers - 1; i++) {
+      double *w = weights[i].values();
+      size_t n = (size_t)weights[i].getRows() * weights[i].getCols();
+      size_t k = (size_t)(sparsity * n);
+
+      // Indices of the k smallest magnitudes
+      std::vector<uint32_t> order(n);
+      for (size_t j = 0; j < n; j++) {
+         order[j] = j;
+      }
+      if (k > 0 && k < n) {
+         std::nth_element(order.begin(), order.begin() + k, order.end(),
+                          [w](uint32_t a, uint32_t b) { return std::abs(w[a]) < std::abs(w[b]); });
+      }
+
+      // Weights pruned earlier stay pruned, so repeated calls only ever add to the mask.
+      pruneMasks[i].resize(n, 0);
+      for (size_t j = 0; j < k; j++) {
+         pruneMasks[i][order[j]] = 1;
+      }
+      for (size_t j = 0; j < n; j++) {
+         if (pruneMasks[i][j])
+            w[j] = 0.0;
+      }
+   }
+   return getSparsity();
+}
+
+void NeuralNetwork::clearPruneMask() { pruneMasks.clear(); }
+
+double NeuralNetwork::getSparsity() const {
+   size_t zeros = 0, total = 0;
+   for (const Matrix &w : weights) {
+      size_t n = (size_t)w.getRows() * w.getCols();
+      zeros += std::count(w.values(), w.values() + n, 0.0);
+      total += n;
+   }
+   return total > 0 ? (double)zeros / total : 0.0;
+}
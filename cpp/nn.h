@@ -1,9 +1,15 @@
 #ifndef NN_H
 #define NN_H
 
+#include "augment.h"
+#include "cache.h"
+#include "checkpoint.h"
 #include "matrix.h"
+#include "pipeline.h"
+#include "tensor.h"
 #include <cmath>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 class NeuralNetwork {
@@ -11,7 +17,8 @@ private:
    std::vector<int> layerSizes;
    int numLayers;
    double lrnRate;
-   double lrStep; // Kept for compatibility
+   double lrStep; // Base rate; a Trainer schedule derives lrnRate from it
+   unsigned int seed; // Weight initialization seed
 
    std::vector<Matrix> layers;
    std::vector<Matrix> weights;
@@ -20,21 +27,104 @@ private:
    std::vector<Matrix> errors;
    std::vector<Matrix> deltas;
 
+   // trainBatch staging for augmented or strided input rows, reused between calls
+   Matrix batchInput = Matrix(0, 0);
+   uint64_t stagedBytes = 0;
+   std::shared_ptr<Augmenter> augmenter; // Distorts trainBatch inputs while staging, if set
+   std::vector<std::vector<uint8_t>> pruneMasks; // Per layer, 1 = pruned weight pinned at zero
+   uint64_t weightsVersion = 0; // New value on every change to the weights or biases
+   std::shared_ptr<InferenceCache> inferenceCache; // feedForward results, if set
+   std::vector<double> cachedActivations;
+
+   // out = sigmoid(a * w + b) for every row of a; a must be contiguous (stride == cols)
+   static void forwardLayer(const MatrixView &a, const Matrix &w, const Matrix &b, Matrix &out);
+
+   // Forward and backward pass over every row of input into caller-owned scratch,
+   // so concurrent callers never share layers/errors/deltas.
+   // The first layer reads input in place (contiguous rows), so acts[0] is left untouched.
+   void backprop(const MatrixView &input, const MatrixView &target, std::vector<Matrix> &acts,
+                 std::vector<Matrix> &errs, std::vector<Matrix> &dlts) const;
+   // Adds scale * a^T * delta to every weight matrix (and the delta rows to the biases); layer 0 uses input.
+   void applyDeltas(const MatrixView &input, const std::vector<Matrix> &acts, const std::vector<Matrix> &dlts,
+                    double scale);
+   void applyPruneMasks(); // Pins pruned weights back at zero
+   void applyPruneMask(int layer);
+   void weightsChanged(); // Bumps weightsVersion, which invalidates cached inference results
+   // Rows for the first layer: inputs in place, or a copy in batchInput when they are augmented or strided.
+   MatrixView stageBatch(const MatrixView &inputs);
+   // One batched SGD step on rows of inputs and targets at lrnRate / rows.
+   void trainRows(const MatrixView &inputs, const MatrixView &targets);
+   std::vector<double> predictRows(const MatrixView &inputs) const;
+   // One per-sample SGD step: backprop then applyDeltas at the learning rate.
+   void sgdStep(const Matrix &input, const Matrix &target, std::vector<Matrix> &acts, std::vector<Matrix> &errs,
+                std::vector<Matrix> &dlts);
+
 public:
    NeuralNetwork(int numInp, std::vector<int> hiddenSizes, int numOut, double lrnRate = 0.1);
+   // Reproducible initialization: the same seed gives the same weights on every machine and thread count.
+   NeuralNetwork(int numInp, std::vector<int> hiddenSizes, int numOut, double lrnRate, unsigned int seed);
+
+   void reseed(unsigned int seed); // Re-initializes all weights and biases from seed
+   unsigned int getSeed() const;
 
    Matrix feedForward(const Matrix &input);
    Matrix feedForwardArray(const std::vector<double> &input); // Helper for JS array input
 
+   // Batched inference on batchSize row-major inputs; returns batchSize * numOut outputs.
+   // Does not touch the layers member, so it is safe to call concurrently.
+   std::vector<double> predictBatch(const std::vector<double> &inputs, int batchSize) const;
+   std::vector<double> predictBatch(const Tensor &inputs) const; // batch x numInp view
+
    void train(const Matrix &input, const Matrix &target);
    void trainArray(const std::vector<double> &input, const std::vector<double> &target);
    void trainBatch(const std::vector<double> &inputs, const std::vector<double> &targets, int batchSize);
+   // Same step on (batch x numInp, batch x numOut) tensor views, e.g. slices of the whole dataset,
+   // so no per-batch arrays are built. Rows may be strided; each row must be contiguous.
+   // Contiguous input rows feed the first layer in place; augmented or strided rows are copied first.
+   void trainBatch(const Tensor &inputs, const Tensor &targets);
+   uint64_t getStagedBytes() const; // Input bytes copied for training batches so far
+
+   // Split trainBatch for data-parallel training: computeUpdate fills update with the change
+   // trainBatch would make (flat, see getParameters) without applying it; applyUpdate adds one.
+   void computeUpdate(const std::vector<double> &inputs, const std::vector<double> &targets, int batchSize,
+                      std::vector<double> &update);
+   void applyUpdate(const std::vector<double> &update);
+
+   // All weights and biases as one flat vector: per layer, weights row-major then biases.
+   int getParameterCount() const;
+   void getParameters(std::vector<double> &out) const;
+   void setParameters(const std::vector<double> &params);
 
-   // Getters
+   // Random distortions for every image staged by trainBatch (square inputs only).
+   void setAugmentation(const AugmentConfig &config, unsigned int seed);
+   void clearAugmentation();
+
+   // LRU cache in front of feedForward, keyed on the input quantized to levels steps over [0, 1].
+   // Repeated (or near-identical) inputs return the stored outputs and activations until the
+   // weights change. Copies of the network share the cache.
+   void setInferenceCache(int capacity, int levels = 256);
+   void clearInferenceCache();
+   CacheStats getInferenceCacheStats() const;
+   uint64_t getWeightsVersion() const;
+
+   // Hogwild: numThreads shards of per-sample SGD updating the shared weights without locks.
+   // numThreads <= 0 uses every hardware thread; builds without threads run the shards serially.
+   void trainHogwild(const std::vector<double> &inputs, const std::vector<double> &targets, int count,
+                     int numThreads = 0);
+
+   // Pipeline parallelism for small batches: each weight layer is a stage on its own thread, and
+   // microbatches stream through lock-free queues, so layer 0 of one microbatch overlaps the later
+   // layers of the previous ones. See PipelineConfig for the staleness bound. Builds without
+   // threads train one microbatch at a time (trainBatch).
+   void trainPipelined(const std::vector<double> &inputs, const std::vector<double> &targets, int count,
+                       const PipelineConfig &config);
+
+   // Getters. Zero-copy views: weights and biases are updated in place by training, so their
+   // views stay valid until setWeights/setBiases/restore; layer views until the batch size changes.
    int getNumLayers() const;
-   Matrix getLayer(int index) const;
-   Matrix getWeights(int index) const;
-   Matrix getBiases(int index) const;
+   MatrixView getLayer(int index) const;
+   MatrixView getWeights(int index) const;
+   MatrixView getBiases(int index) const;
 
    // Optimized getters for visualization
    double getNeuronVal(int layerIdx, int neuronIdx) const;
@@ -50,8 +140,23 @@ public:
    void setLrStep(double step);
 
    // For saving/loading
+   // Loads every layer from model.json text (see parseModelJson). The shapes must match this
+   // network; on failure nothing changes and false is returned.
+   bool loadModelJson(const std::string &text);
    void setWeights(int index, const Matrix &w);
    void setBiases(int index, const Matrix &b);
+
+   // Zeroes the smallest-magnitude fraction `sparsity` of each weight matrix and keeps those
+   // weights at zero during further training (fine-tuning). Returns the overall sparsity.
+   double prune(double sparsity);
+   void clearPruneMask();   // Lets pruned weights train again
+   double getSparsity() const; // Fraction of weights that are exactly zero
+
+   // Copies weights, biases, learning rate and augmentation position into out, reusing its buffers.
+   void snapshot(Checkpoint &out) const;
+   // Loads a snapshot; returns false if it was taken from a different architecture.
+   // Call setAugmentation first, so the distortions continue where the run stopped.
+   bool restore(const Checkpoint &ckpt);
 };
 
 #endif
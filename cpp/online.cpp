@@ -0,0 +1,138 @@
+#include "online.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+OnlineLearner::OnlineLearner(NeuralNetwork &nn, const OnlineConfig &config, unsigned int seed)
+    : nn(nn), config(config), inputSize(nn.getLayerSize(0)), outputSize(nn.getLayerSize(nn.getNumLayers() - 1)),
+      rng(seed, ONLINE_STREAM) {
+   this->config.capacity = std::max(1, config.capacity);
+   this->config.batchSize = std::max(1, config.batchSize);
+   this->config.userFraction = std::min(1.0, std::max(0.0, config.userFraction));
+   userInputs.resize((size_t)this->config.capacity * inputSize);
+   userTargets.resize((size_t)this->config.capacity * outputSize);
+}
+
+void OnlineLearner::addSample(const std::vector<double> &input, const std::vector<double> &target) {
+   if (input.size() != (size_t)inputSize || target.size() != (size_t)outputSize) {
+      throw std::invalid_argument("Sample does not match the network!");
+   }
+   std::copy(input.begin(), input.end(), userInputs.begin() + (size_t)userNext * inputSize);
+   std::copy(target.begin(), target.end(), userTargets.begin() + (size_t)userNext * outputSize);
+   userNext = (userNext + 1) % config.capacity;
+   userCount = std::min(userCount + 1, config.capacity);
+   fresh = std::min(fresh + 1, config.capacity);
+}
+
+void OnlineLearner::addPool(const std::vector<double> &inputs, const std::vector<double> &targets, int count) {
+   if (count <= 0)
+      return;
+   if (inputs.size() < (size_t)count * inputSize || targets.size() < (size_t)count * outputSize) {
+      throw std::invalid_argument("Pool data is smaller than count!");
+   }
+   poolInputs.insert(poolInputs.end(), inputs.begin(), inputs.begin() + (size_t)count * inputSize);
+   poolTargets.insert(poolTargets.end(), targets.begin(), targets.begin() + (size_t)count * outputSize);
+   poolCount += count;
+}
+
+int OnlineLearner::addPoolBytes(const uint8_t *records, size_t size) {
+   size_t recordSize = inputSize + 1;
+   if (size % recordSize != 0) {
+      throw std::invalid_argument("Pool data is not a whole number of records!");
+   }
+   int count = size / recordSize;
+   for (int i = 0; i < count; i++) {
+      if (records[i * recordSize + inputSize] >= outputSize) {
+         throw std::invalid_argument("Pool label is out of range!");
+      }
+   }
+   poolInputs.reserve(poolInputs.size() + (size_t)count * inputSize);
+   poolTargets.resize(poolTargets.size() + (size_t)count * outputSize, 0.0);
+   for (int i = 0; i < count; i++) {
+      const uint8_t *r = records + i * recordSize;
+      for (int k = 0; k < inputSize; k++) {
+         poolInputs.push_back(r[k] / 255.0);
+      }
+      poolTargets[(size_t)(poolCount + i) * outputSize + r[inputSize]] = 1.0;
+   }
+   poolCount += count;
+   return count;
+}
+
+void OnlineLearner::fillBatch(int batch, int fromUser) {
+   batchInputs.resize((size_t)batch * inputSize);
+   batchTargets.resize((size_t)batch * outputSize);
+   for (int b = 0; b < batch; b++) {
+      bool user = b < fromUser;
+      int count = user ? userCount : poolCount;
+      int i = std::min(count - 1, (int)rng.uniform(0, count));
+      const std::vector<double> &in = user ? userInputs : poolInputs;
+      const std::vector<double> &tgt = user ? userTargets : poolTargets;
+      std::copy_n(in.begin() + (size_t)i * inputSize, inputSize, batchInputs.begin() + (size_t)b * inputSize);
+      std::copy_n(tgt.begin() + (size_t)i * outputSize, outputSize, batchTargets.begin() + (size_t)b * outputSize);
+   }
+}
+
+int OnlineLearner::step(double timeBudgetMs) {
+   using Clock = std::chrono::steady_clock;
+   if (userCount == 0 || timeBudgetMs <= 0)
+      return 0;
+
+   // Without a pool, replaying drawings would only pull the network toward them: the new
+   // drawings are trained once, as one batch, and later steps do nothing.
+   if (poolCount == 0) {
+      int batch = std::min(fresh, config.batchSize);
+      if (batch == 0)
+         return 0;
+      batchInputs.resize((size_t)batch * inputSize);
+      batchTargets.resize((size_t)batch * outputSize);
+      for (int b = 0; b < batch; b++) {
+         int i = (userNext - 1 - b + config.capacity) % config.capacity;
+         std::copy_n(userInputs.begin() + (size_t)i * inputSize, inputSize, batchInputs.begin() + (size_t)b * inputSize);
+         std::copy_n(userTargets.begin() + (size_t)i * outputSize, outputSize,
+                     batchTargets.begin() + (size_t)b * outputSize);
+      }
+      nn.trainBatch(batchInputs, batchTargets, batch);
+      fresh = 0;
+      trained += batch;
+      return batch;
+   }
+
+   int batch = config.batchSize;
+   int fromUser = std::max(1, (int)(batch * config.userFraction + 0.5));
+   Clock::time_point start = Clock::now();
+   int samples = 0;
+   while (true) {
+      // Run a batch only if it fits even at the recent worst-case cost, so a slow batch (cache
+      // misses, descheduling) is planned for instead of noticed after it overran.
+      double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+      if (elapsed + batchMs > timeBudgetMs) {
+         if (samples == 0)
+            batchMs *= 0.95; // So one outlier cannot stop training for good
+         break;
+      }
+
+      Clock::time_point batchStart = Clock::now();
+      fillBatch(batch, fromUser);
+      nn.trainBatch(batchInputs, batchTargets, batch);
+      samples += batch;
+
+      double ms = std::chrono::duration<double, std::milli>(Clock::now() - batchStart).count();
+      batchMs = std::max(ms, 0.95 * batchMs);
+   }
+   fresh = 0;
+   trained += samples;
+   return samples;
+}
+
+int OnlineLearner::getBufferCount() const { return userCount; }
+
+int OnlineLearner::getPoolCount() const { return poolCount; }
+
+double OnlineLearner::getSamplesTrained() const { return trained; }
+
+void OnlineLearner::clearBuffer() {
+   userCount = 0;
+   userNext = 0;
+   fresh = 0;
+}
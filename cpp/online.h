@@ -0,0 +1,67 @@
+#ifndef ONLINE_H
+#define ONLINE_H
+
+#include "nn.h"
+#include "rng.h"
+#include <cstdint>
+#include <vector>
+
+struct OnlineConfig {
+   int capacity = 256;         // Recent user samples kept for replay
+   int batchSize = 8;
+   double userFraction = 0.5;  // Share of each batch drawn from user samples, the rest from the pool
+};
+
+// Incremental learning from user drawings with a bounded cost per call. New samples go into a
+// ring buffer; step() trains mini-batches mixing random buffered samples with random samples
+// from a fixed pool of the original training data (so the base model is rehearsed instead of
+// forgotten) until its time budget would be exceeded. With an empty pool each new sample is
+// trained once and nothing is replayed. The network must outlive the learner.
+class OnlineLearner {
+private:
+   static const uint64_t ONLINE_STREAM = 0x0111ull << 32;
+
+   NeuralNetwork &nn;
+   OnlineConfig config;
+   int inputSize;
+   int outputSize;
+
+   std::vector<double> userInputs; // Ring buffer, capacity rows
+   std::vector<double> userTargets;
+   int userCount = 0;
+   int userNext = 0; // Slot the next sample overwrites
+   int fresh = 0;    // Samples added since the last step
+
+   std::vector<double> poolInputs;
+   std::vector<double> poolTargets;
+   int poolCount = 0;
+
+   RngStream rng;
+   std::vector<double> batchInputs;
+   std::vector<double> batchTargets;
+   double batchMs = 0; // Recent worst-case cost of one batch, decaying slowly
+   double trained = 0;
+
+   void fillBatch(int batch, int fromUser);
+
+public:
+   OnlineLearner(NeuralNetwork &nn, const OnlineConfig &config, unsigned int seed);
+
+   void addSample(const std::vector<double> &input, const std::vector<double> &target);
+   // Appends count row-major samples to the rehearsal pool.
+   void addPool(const std::vector<double> &inputs, const std::vector<double> &targets, int count);
+   // Records of inputSize pixel bytes (0-255) followed by one label byte; returns the number added.
+   // Throws if the size is not a whole number of records or a label is out of range.
+   int addPoolBytes(const uint8_t *records, size_t size);
+
+   // Trains mixed mini-batches while the estimated cost of the next one fits in what is left of
+   // timeBudgetMs. Returns the number of samples trained, 0 if there is nothing to learn.
+   int step(double timeBudgetMs);
+
+   int getBufferCount() const;
+   int getPoolCount() const;
+   double getSamplesTrained() const;
+   void clearBuffer(); // Forgets the user samples, keeps the pool
+};
+
+#endif
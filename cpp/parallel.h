@@ -0,0 +1,53 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Threads exist natively and in wasm builds compiled with -pthread.
+// The default browser build has none, so everything runs on the caller.
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define NN_HAS_THREADS 0
+#else
+#define NN_HAS_THREADS 1
+#endif
+
+inline int hardwareThreads() {
+#if NN_HAS_THREADS
+   unsigned int n = std::thread::hardware_concurrency();
+   return n > 0 ? (int)n : 1;
+#else
+   return 1;
+#endif
+}
+
+// Splits [0, count) into numThreads contiguous shards and runs
+// fn(threadIdx, begin, end) for each one. Shard 0 runs on the caller.
+inline void parallelFor(int count, int numThreads, const std::function<void(int, int, int)> &fn) {
+   if (count <= 0)
+      return;
+   numThreads = std::max(1, std::min(numThreads, count));
+#if !NN_HAS_THREADS
+   numThreads = 1;
+#endif
+   if (numThreads == 1) {
+      fn(0, 0, count);
+      return;
+   }
+
+   std::vector<std::thread> workers;
+   workers.reserve(numThreads - 1);
+   for (int t = 1; t < numThreads; t++) {
+      int begin = (int)((long long)count * t / numThreads);
+      int end = (int)((long long)count * (t + 1) / numThreads);
+      workers.emplace_back(fn, t, begin, end);
+   }
+   fn(0, 0, (int)((long long)count / numThreads));
+   for (auto &w : workers) {
+      w.join();
+   }
+}
+
+#endif
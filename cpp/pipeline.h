@@ -0,0 +1,58 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Settings for NeuralNetwork::trainPipelined.
+//
+// Staleness: every weight matrix is owned by one stage, which applies a microbatch's update as
+// soon as that microbatch's backward pass reaches it. A new microbatch is only injected once
+// fewer than maxInFlight are between injection and their last update, so its forward pass
+// sees the updates of every microbatch at least maxInFlight older, plus possibly some newer
+// ones: the staleness is at most maxInFlight - 1 updates. maxInFlight = 1 is exactly serial SGD.
+struct PipelineConfig {
+   int batchSize = 1;        // Samples per microbatch
+   int maxInFlight = 0;      // Microbatches in the pipeline at once, 0 = one per stage
+   bool stashWeights = true; // Backpropagate errors through the weights the forward pass used
+};
+
+// Bounded single-producer single-consumer ring buffer. push and pop never block or lock;
+// they fail when the queue is full or empty.
+template <typename T> class SpscQueue {
+private:
+   std::vector<T> slots;
+   size_t mask;
+   alignas(64) std::atomic<size_t> head; // Next slot to pop, written by the consumer
+   alignas(64) std::atomic<size_t> tail; // Next slot to push, written by the producer
+
+public:
+   explicit SpscQueue(size_t capacity) : head(0), tail(0) {
+      size_t size = 1;
+      while (size < capacity)
+         size *= 2;
+      slots.resize(size);
+      mask = size - 1;
+   }
+
+   bool push(const T &item) {
+      size_t t = tail.load(std::memory_order_relaxed);
+      if (t - head.load(std::memory_order_acquire) == slots.size())
+         return false;
+      slots[t & mask] = item;
+      tail.store(t + 1, std::memory_order_release);
+      return true;
+   }
+
+   bool pop(T &item) {
+      size_t h = head.load(std::memory_order_relaxed);
+      if (h == tail.load(std::memory_order_acquire))
+         return false;
+      item = slots[h & mask];
+      head.store(h + 1, std::memory_order_release);
+      return true;
+   }
+};
+
+#endif
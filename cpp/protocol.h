@@ -0,0 +1,55 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Wire format of the inference server (bin/server) and its load generator.
+// Unix domain sockets only, so structs go over the wire in host byte order.
+// A client may pipeline any number of requests on one connection; responses
+// carry the request id because batches can complete them out of order.
+static const int PROTO_NUM_INP = 28 * 28;
+static const int PROTO_NUM_OUT = 10;
+
+struct InferRequest {
+   uint32_t id;
+   float pixels[PROTO_NUM_INP]; // 0.0 to 1.0, row-major 28x28
+};
+
+struct InferResponse {
+   uint32_t id;
+   float probs[PROTO_NUM_OUT];
+};
+
+inline bool readFull(int fd, void *buf, size_t len) {
+   char *p = static_cast<char *>(buf);
+   while (len > 0) {
+      ssize_t n = read(fd, p, len);
+      if (n < 0 && errno == EINTR)
+         continue;
+      if (n <= 0)
+         return false;
+      p += n;
+      len -= n;
+   }
+   return true;
+}
+
+inline bool writeFull(int fd, const void *buf, size_t len) {
+   const char *p = static_cast<const char *>(buf);
+   while (len > 0) {
+      ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR)
+         continue;
+      if (n <= 0)
+         return false;
+      p += n;
+      len -= n;
+   }
+   return true;
+}
+
+#endif
@@ -0,0 +1,573 @@
+// Data-parallel training with a parameter server. Build with ./build-native.sh, run from the repo root:
+//   bin/ps local  [--workers N] [options]       forks N workers against a server on this machine and
+//                                               compares the run with a single process
+//   bin/ps server  --workers N  [options]       one server for workers on other machines
+//   bin/ps worker  --id I --workers N [options] trains shard I of N
+// Options: --epochs E --batch B --rate R --compress fp32|fp16|topk|fp64 --topk-ratio F
+//          --socket PATH (Unix, default /tmp/nn-ps.sock) or --host H --port P (TCP)
+//
+// Each worker runs computeUpdate on its shard one batch at a time, pushes the update (optionally
+// compressed, with the rounding error carried into its next push) and continues from the fp64
+// weights the server sends back. The server applies pushes as they arrive (asynchronous SGD).
+// Messages are in host byte order, so TCP runs need hosts of the same endianness.
+#include "mnist.h"
+#include "nn.h"
+#include "protocol.h"
+#include "rng.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <numeric>
+#include <string>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <vector>
+
+static const int HOLDOUT = 10000;
+static const unsigned int SEED = 42;
+
+enum MsgType : uint32_t { MSG_HELLO = 1, MSG_PUSH = 2, MSG_DONE = 3 };
+enum Encoding : uint32_t { ENC_FP32 = 0, ENC_FP16 = 1, ENC_TOPK = 2, ENC_FP64 = 3 };
+
+// Worker -> server. HELLO carries the parameter count in entries and is answered with the
+// weights; PUSH is followed by the payload and also answered with the weights; DONE ends the
+// connection. Payload: FP32 float[entries], FP16 uint16[entries], TOPK entries x TopkEntry,
+// FP64 double[entries] (uncompressed).
+struct PushHeader {
+   uint32_t type;
+   uint32_t encoding;
+   uint32_t entries;
+   uint32_t samples; // Training samples behind this update
+};
+
+struct TopkEntry {
+   uint32_t index;
+   float value;
+};
+
+// Server -> worker, followed by double[count]: the server keeps fp64 weights and sends them
+// unrounded, so workers compute their updates on exactly the server's model.
+struct WeightsHeader {
+   uint32_t count;
+   uint32_t version; // Updates applied so far
+};
+
+struct Options {
+   int workers = 2;
+   int id = 0;
+   int epochs = 1;
+   int batch = 32;
+   double rate = 0.1;
+   Encoding encoding = ENC_FP32;
+   double topkRatio = 0.01;
+   std::string socketPath = "/tmp/nn-ps.sock";
+   std::string host = "127.0.0.1";
+   int port = 0; // TCP when set
+};
+
+static NeuralNetwork makeNetwork(const Options &opt) {
+   return NeuralNetwork(MNIST_NUM_INP, {64, 64}, MNIST_NUM_OUT, opt.rate, SEED);
+}
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+   return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double accuracy(const NeuralNetwork &nn, const Dataset &d, int begin) {
+   int n = d.count - begin;
+   std::vector<double> in(d.inputs.begin() + (size_t)begin * MNIST_NUM_INP, d.inputs.end());
+   std::vector<double> out = nn.predictBatch(in, n);
+   int correct = 0;
+   for (int i = 0; i < n; i++) {
+      const double *o = &out[(size_t)i * MNIST_NUM_OUT];
+      correct += std::max_element(o, o + MNIST_NUM_OUT) - o == d.labels[begin + i];
+   }
+   return 100.0 * correct / n;
+}
+
+// IEEE half precision, round to nearest. Updates are far below the fp16 range, so
+// overflow saturates to infinity without NaN handling.
+static uint16_t toHalf(float f) {
+   uint32_t x;
+   std::memcpy(&x, &f, 4);
+   uint32_t sign = (x >> 16) & 0x8000;
+   int exp = (int)((x >> 23) & 0xff) - 127 + 15;
+   uint32_t mant = x & 0x7fffff;
+   if (exp >= 31)
+      return sign | 0x7c00;
+   if (exp <= 0) {
+      if (exp < -10)
+         return sign;
+      mant |= 0x800000;
+      int shift = 14 - exp;
+      uint32_t half = mant >> shift;
+      half += (mant >> (shift - 1)) & 1;
+      return sign | half;
+   }
+   uint32_t half = sign | (exp << 10) | (mant >> 13);
+   half += (mant >> 12) & 1; // A carry into the exponent is still the correct rounding
+   return half;
+}
+
+static float fromHalf(uint16_t h) {
+   uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+   uint32_t exp = (h >> 10) & 0x1f;
+   uint32_t mant = h & 0x3ff;
+   if (exp == 0) {
+      float f = mant * 5.9604645e-8f; // Subnormal: mant * 2^-24
+      return sign ? -f : f;
+   }
+   uint32_t x = sign | (exp == 31 ? 0x7f800000 : ((exp + 112) << 23 | mant << 13));
+   float f;
+   std::memcpy(&f, &x, 4);
+   return f;
+}
+
+// Encodes update + residual into payload and leaves in residual what the encoding lost,
+// so every coordinate eventually reaches the server (error feedback).
+static uint32_t encodeUpdate(const Options &opt, const std::vector<double> &update, std::vector<double> &residual,
+                             std::vector<uint8_t> &payload) {
+   size_t n = update.size();
+   residual.resize(n, 0.0);
+   for (size_t k = 0; k < n; k++) {
+      residual[k] += update[k];
+   }
+
+   if (opt.encoding == ENC_TOPK) {
+      size_t keep = std::max<size_t>(1, std::min(n, (size_t)(opt.topkRatio * n)));
+      std::vector<uint32_t> idx(n);
+      std::iota(idx.begin(), idx.end(), 0);
+      std::nth_element(idx.begin(), idx.begin() + keep - 1, idx.end(),
+                       [&](uint32_t a, uint32_t b) { return std::abs(residual[a]) > std::abs(residual[b]); });
+      payload.resize(keep * sizeof(TopkEntry));
+      TopkEntry *out = reinterpret_cast<TopkEntry *>(payload.data());
+      for (size_t i = 0; i < keep; i++) {
+         out[i] = {idx[i], (float)residual[idx[i]]};
+         residual[idx[i]] -= out[i].value;
+      }
+      return keep;
+   }
+
+   if (opt.encoding == ENC_FP64) {
+      payload.resize(n * sizeof(double));
+      std::memcpy(payload.data(), residual.data(), n * sizeof(double));
+      std::fill(residual.begin(), residual.end(), 0.0);
+      return n;
+   }
+
+   if (opt.encoding == ENC_FP16) {
+      payload.resize(n * sizeof(uint16_t));
+      uint16_t *out = reinterpret_cast<uint16_t *>(payload.data());
+      for (size_t k = 0; k < n; k++) {
+         out[k] = toHalf((float)residual[k]);
+         residual[k] -= fromHalf(out[k]);
+      }
+      return n;
+   }
+
+   payload.resize(n * sizeof(float));
+   float *out = reinterpret_cast<float *>(payload.data());
+   for (size_t k = 0; k < n; k++) {
+      out[k] = (float)residual[k];
+      residual[k] -= out[k];
+   }
+   return n;
+}
+
+static size_t payloadSize(const PushHeader &h) {
+   switch (h.encoding) {
+   case ENC_FP16:
+      return (size_t)h.entries * sizeof(uint16_t);
+   case ENC_TOPK:
+      return (size_t)h.entries * sizeof(TopkEntry);
+   case ENC_FP64:
+      return (size_t)h.entries * sizeof(double);
+   default:
+      return (size_t)h.entries * sizeof(float);
+   }
+}
+
+struct ServerState {
+   std::mutex lock;
+   std::vector<double> params;
+   uint32_t version = 0;
+   long long samples = 0;
+   long long bytesIn = 0;
+   long long bytesOut = 0;
+   std::chrono::steady_clock::time_point firstWorker; // When the first worker connected
+};
+
+// Answers one worker until it sends DONE or disconnects.
+static void serveWorker(int fd, ServerState &state) {
+   std::vector<uint8_t> payload;
+   std::vector<double> reply;
+   PushHeader h;
+   size_t count = state.params.size();
+   while (readFull(fd, &h, sizeof(h)) && h.type != MSG_DONE) {
+      if (h.type == MSG_HELLO && h.entries != count) {
+         std::fprintf(stderr, "Worker has %u parameters, server %zu\n", h.entries, count);
+         break;
+      }
+      if (h.type == MSG_PUSH) {
+         if (h.encoding > ENC_FP64 || (h.encoding != ENC_TOPK && h.entries != count) || h.entries > count)
+            break;
+         payload.resize(payloadSize(h));
+         if (!readFull(fd, payload.data(), payload.size()))
+            break;
+      } else if (h.type != MSG_HELLO) {
+         break;
+      }
+
+      WeightsHeader w;
+      {
+         std::lock_guard<std::mutex> lk(state.lock);
+         double *p = state.params.data();
+         if (h.type == MSG_PUSH) {
+            if (h.encoding == ENC_FP32) {
+               const float *v = reinterpret_cast<const float *>(payload.data());
+               for (size_t k = 0; k < count; k++)
+                  p[k] += v[k];
+            } else if (h.encoding == ENC_FP64) {
+               const double *v = reinterpret_cast<const double *>(payload.data());
+               for (size_t k = 0; k < count; k++)
+                  p[k] += v[k];
+            } else if (h.encoding == ENC_FP16) {
+               const uint16_t *v = reinterpret_cast<const uint16_t *>(payload.data());
+               for (size_t k = 0; k < count; k++)
+                  p[k] += fromHalf(v[k]);
+            } else {
+               const TopkEntry *v = reinterpret_cast<const TopkEntry *>(payload.data());
+               for (uint32_t i = 0; i < h.entries; i++) {
+                  if (v[i].index < count)
+                     p[v[i].index] += v[i].value;
+               }
+            }
+            state.version++;
+            state.samples += h.samples;
+            state.bytesIn += sizeof(h) + payload.size();
+         }
+         reply.assign(p, p + count);
+         w.count = count;
+         w.version = state.version;
+         state.bytesOut += sizeof(w) + count * sizeof(double);
+      }
+      if (!writeFull(fd, &w, sizeof(w)) || !writeFull(fd, reply.data(), count * sizeof(double)))
+         break;
+   }
+   close(fd);
+}
+
+// Serves `workers` connections on listenFd to completion, updating params in place.
+static void runServer(int listenFd, int workers, ServerState &state) {
+   std::vector<std::thread> threads;
+   for (int i = 0; i < workers; i++) {
+      int fd = accept(listenFd, nullptr, nullptr);
+      if (fd < 0) {
+         i--;
+         continue;
+      }
+      if (i == 0)
+         state.firstWorker = std::chrono::steady_clock::now();
+      threads.emplace_back(serveWorker, fd, std::ref(state));
+   }
+   for (std::thread &t : threads) {
+      t.join();
+   }
+}
+
+static bool receiveWeights(int fd, NeuralNetwork &nn, std::vector<double> &params) {
+   WeightsHeader w;
+   if (!readFull(fd, &w, sizeof(w)) || w.count != (uint32_t)nn.getParameterCount())
+      return false;
+   params.resize(w.count);
+   if (!readFull(fd, params.data(), params.size() * sizeof(double)))
+      return false;
+   nn.setParameters(params);
+   return true;
+}
+
+// Trains shard opt.id of opt.workers over the connection fd. Returns false on a protocol error.
+static bool runWorker(const Dataset &d, int trainCount, const Options &opt, int fd) {
+   NeuralNetwork nn = makeNetwork(opt);
+   std::vector<double> params, update, residual;
+   std::vector<uint8_t> payload;
+
+   PushHeader h = {MSG_HELLO, opt.encoding, (uint32_t)nn.getParameterCount(), 0};
+   if (!writeFull(fd, &h, sizeof(h)) || !receiveWeights(fd, nn, params))
+      return false;
+
+   int begin = (long long)trainCount * opt.id / opt.workers;
+   int end = (long long)trainCount * (opt.id + 1) / opt.workers;
+   int shard = end - begin;
+   std::vector<double> in, tgt;
+   for (int epoch = 0; epoch < opt.epochs; epoch++) {
+      std::vector<int> order = permutation(shard, SEED + opt.id, epoch, 1);
+      for (int i = 0; i < shard; i += opt.batch) {
+         int batch = std::min(opt.batch, shard - i);
+         in.resize((size_t)batch * MNIST_NUM_INP);
+         tgt.resize((size_t)batch * MNIST_NUM_OUT);
+         for (int j = 0; j < batch; j++) {
+            size_t idx = begin + order[i + j];
+            std::copy_n(d.inputs.begin() + idx * MNIST_NUM_INP, MNIST_NUM_INP, in.begin() + (size_t)j * MNIST_NUM_INP);
+            std::copy_n(d.targets.begin() + idx * MNIST_NUM_OUT, MNIST_NUM_OUT,
+                        tgt.begin() + (size_t)j * MNIST_NUM_OUT);
+         }
+         nn.computeUpdate(in, tgt, batch, update);
+
+         h = {MSG_PUSH, opt.encoding, encodeUpdate(opt, update, residual, payload), (uint32_t)batch};
+         if (!writeFull(fd, &h, sizeof(h)) || !writeFull(fd, payload.data(), payload.size()) ||
+             !receiveWeights(fd, nn, params))
+            return false;
+      }
+   }
+   h = {MSG_DONE, opt.encoding, 0, 0};
+   writeFull(fd, &h, sizeof(h));
+   return true;
+}
+
+static int listenOn(const Options &opt) {
+   int fd;
+   if (opt.port > 0) {
+      fd = socket(AF_INET, SOCK_STREAM, 0);
+      int one = 1;
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      sockaddr_in addr{};
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_ANY);
+      addr.sin_port = htons(opt.port);
+      if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0)
+         return -1;
+   } else {
+      fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      sockaddr_un addr{};
+      addr.sun_family = AF_UNIX;
+      std::strncpy(addr.sun_path, opt.socketPath.c_str(), sizeof(addr.sun_path) - 1);
+      unlink(opt.socketPath.c_str());
+      if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0)
+         return -1;
+   }
+   return fd;
+}
+
+static int connectTo(const Options &opt) {
+   int fd = -1;
+   if (opt.port > 0) {
+      addrinfo hints{}, *res = nullptr;
+      hints.ai_family = AF_INET;
+      hints.ai_socktype = SOCK_STREAM;
+      if (getaddrinfo(opt.host.c_str(), std::to_string(opt.port).c_str(), &hints, &res) != 0)
+         return -1;
+      fd = socket(AF_INET, SOCK_STREAM, 0);
+      if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+         close(fd);
+         fd = -1;
+      }
+      freeaddrinfo(res);
+      int one = 1;
+      if (fd >= 0)
+         setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Pushes are latency bound
+   } else {
+      fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      sockaddr_un addr{};
+      addr.sun_family = AF_UNIX;
+      std::strncpy(addr.sun_path, opt.socketPath.c_str(), sizeof(addr.sun_path) - 1);
+      if (fd >= 0 && connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+         close(fd);
+         fd = -1;
+      }
+   }
+   return fd;
+}
+
+static void printServerStats(const ServerState &state, double elapsed, size_t paramCount) {
+   double rate = state.samples / elapsed;
+   double pushBytes = state.version ? (double)state.bytesIn / state.version : 0;
+   std::printf("  %lld samples in %.2f s (%.0f samples/s), %u pushes of %.0f bytes (%.1fx smaller than fp64)\n",
+               state.samples, elapsed, rate, state.version, pushBytes,
+               pushBytes > 0 ? paramCount * sizeof(double) / pushBytes : 0.0);
+}
+
+// Single process, same batches and epochs: the baseline the scaling efficiency is measured against.
+// Its final parameters go to params.
+static double singleProcessRate(const Dataset &d, int trainCount, const Options &opt, std::vector<double> &params) {
+   NeuralNetwork nn = makeNetwork(opt);
+   std::vector<double> in, tgt;
+   auto start = std::chrono::steady_clock::now();
+   for (int epoch = 0; epoch < opt.epochs; epoch++) {
+      std::vector<int> order = permutation(trainCount, SEED, epoch, 1);
+      for (int i = 0; i < trainCount; i += opt.batch) {
+         int batch = std::min(opt.batch, trainCount - i);
+         in.resize((size_t)batch * MNIST_NUM_INP);
+         tgt.resize((size_t)batch * MNIST_NUM_OUT);
+         for (int j = 0; j < batch; j++) {
+            size_t idx = order[i + j];
+            std::copy_n(d.inputs.begin() + idx * MNIST_NUM_INP, MNIST_NUM_INP, in.begin() + (size_t)j * MNIST_NUM_INP);
+            std::copy_n(d.targets.begin() + idx * MNIST_NUM_OUT, MNIST_NUM_OUT,
+                        tgt.begin() + (size_t)j * MNIST_NUM_OUT);
+         }
+         nn.trainBatch(in, tgt, batch);
+      }
+   }
+   double elapsed = seconds(start);
+   double rate = (double)trainCount * opt.epochs / elapsed;
+   std::printf("single process : %.0f samples/s, accuracy %.2f%%\n", rate, accuracy(nn, d, trainCount));
+   nn.getParameters(params);
+   return rate;
+}
+
+static int runLocal(const Options &opt) {
+   Dataset d = loadMNIST();
+   int trainCount = d.count - HOLDOUT;
+   std::vector<double> single;
+   double baseRate = singleProcessRate(d, trainCount, opt, single);
+
+   int listenFd = listenOn(opt);
+   if (listenFd < 0) {
+      std::perror("Error: cannot listen");
+      return 1;
+   }
+   ServerState state;
+   NeuralNetwork nn = makeNetwork(opt);
+   nn.getParameters(state.params);
+
+   // Workers inherit the dataset through fork, so loading is not part of the measurement.
+   auto start = std::chrono::steady_clock::now();
+   std::vector<pid_t> children;
+   for (int id = 0; id < opt.workers; id++) {
+      pid_t pid = fork();
+      if (pid == 0) {
+         close(listenFd);
+         Options mine = opt;
+         mine.id = id;
+         int fd = connectTo(mine);
+         bool ok = fd >= 0 && runWorker(d, trainCount, mine, fd);
+         _exit(ok ? 0 : 1);
+      }
+      children.push_back(pid);
+   }
+   runServer(listenFd, opt.workers, state);
+   double elapsed = seconds(start);
+   int failed = 0;
+   for (pid_t pid : children) {
+      int status;
+      waitpid(pid, &status, 0);
+      failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+   }
+   close(listenFd);
+   if (opt.port <= 0)
+      unlink(opt.socketPath.c_str());
+
+   nn.setParameters(state.params);
+   double rate = state.samples / elapsed;
+   const char *names[] = {"fp32", "fp16", "topk", "fp64"};
+   std::printf("%d workers (%s, %s): %.0f samples/s, accuracy %.2f%%, speedup %.2fx, scaling efficiency %.0f%%\n",
+               opt.workers, names[opt.encoding], opt.port > 0 ? "tcp" : "unix", rate, accuracy(nn, d, trainCount),
+               rate / baseRate, 100 * rate / baseRate / opt.workers);
+   printServerStats(state, elapsed, state.params.size());
+   if (opt.workers == 1) {
+      // Same batches in the same order; with fp64 pushes only the summation order differs
+      // (the update is summed before it is added to the weights).
+      double diff = 0;
+      for (size_t k = 0; k < single.size(); k++) {
+         diff = std::max(diff, std::abs(single[k] - state.params[k]));
+      }
+      std::printf("  max |parameter difference| to the single process: %.3g\n", diff);
+   }
+   if (failed) {
+      std::fprintf(stderr, "Error: %d workers failed\n", failed);
+      return 1;
+   }
+   return 0;
+}
+
+static int runServerMain(const Options &opt) {
+   Dataset d = loadMNIST();
+   int listenFd = listenOn(opt);
+   if (listenFd < 0) {
+      std::perror("Error: cannot listen");
+      return 1;
+   }
+   ServerState state;
+   NeuralNetwork nn = makeNetwork(opt);
+   nn.getParameters(state.params);
+   std::printf("Waiting for %d workers\n", opt.workers);
+
+   runServer(listenFd, opt.workers, state);
+   double elapsed = seconds(state.firstWorker);
+   nn.setParameters(state.params);
+   std::printf("Done: accuracy %.2f%%\n", accuracy(nn, d, d.count - HOLDOUT));
+   printServerStats(state, elapsed, state.params.size());
+   return 0;
+}
+
+static int runWorkerMain(const Options &opt) {
+   Dataset d = loadMNIST();
+   int fd = connectTo(opt);
+   if (fd < 0) {
+      std::perror("Error: cannot connect to the server");
+      return 1;
+   }
+   auto start = std::chrono::steady_clock::now();
+   if (!runWorker(d, d.count - HOLDOUT, opt, fd)) {
+      std::fprintf(stderr, "Error: lost the server\n");
+      return 1;
+   }
+   std::printf("Worker %d done in %.2f s\n", opt.id, seconds(start));
+   return 0;
+}
+
+int main(int argc, char **argv) {
+   std::string mode = argc > 1 ? argv[1] : "local";
+   Options opt;
+   for (int i = 2; i < argc; i++) {
+      std::string arg = argv[i];
+      bool hasValue = i + 1 < argc;
+      if (arg == "--workers" && hasValue)
+         opt.workers = std::max(1, std::atoi(argv[++i]));
+      else if (arg == "--id" && hasValue)
+         opt.id = std::atoi(argv[++i]);
+      else if (arg == "--epochs" && hasValue)
+         opt.epochs = std::max(1, std::atoi(argv[++i]));
+      else if (arg == "--batch" && hasValue)
+         opt.batch = std::max(1, std::atoi(argv[++i]));
+      else if (arg == "--rate" && hasValue)
+         opt.rate = std::atof(argv[++i]);
+      else if (arg == "--topk-ratio" && hasValue)
+         opt.topkRatio = std::atof(argv[++i]);
+      else if (arg == "--socket" && hasValue)
+         opt.socketPath = argv[++i];
+      else if (arg == "--host" && hasValue)
+         opt.host = argv[++i];
+      else if (arg == "--port" && hasValue)
+         opt.port = std::atoi(argv[++i]);
+      else if (arg == "--compress" && hasValue) {
+         std::string c = argv[++i];
+         opt.encoding = c == "fp16" ? ENC_FP16 : c == "topk" ? ENC_TOPK : c == "fp64" ? ENC_FP64 : ENC_FP32;
+      } else {
+         std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+         return 1;
+      }
+   }
+   if (opt.id < 0 || opt.id >= opt.workers) {
+      std::fprintf(stderr, "Error: --id must be in 0..workers-1\n");
+      return 1;
+   }
+
+   if (mode == "local")
+      return runLocal(opt);
+   if (mode == "server")
+      return runServerMain(opt);
+   if (mode == "worker")
+      return runWorkerMain(opt);
+   std::fprintf(stderr, "Usage: ps local|server|worker [--workers N] [--id I] [--epochs E] [--batch B] [--rate R]\n"
+                        "          [--compress fp32|fp16|topk|fp64] [--topk-ratio F] [--socket PATH | --host H --port P]\n");
+   return 1;
+}
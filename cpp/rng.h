@@ -0,0 +1,76 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include "parallel.h"
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Counter-based generator: the i-th number of a stream is a pure function of
+// (seed, stream, i), computed with the SplitMix64 finalizer. Any element can be
+// generated independently, so parallel fills give identical results for every
+// thread count and a run is reproduced from its seed alone.
+class CounterRng {
+private:
+   static const uint64_t GOLDEN = 0x9e3779b97f4a7c15ull;
+   uint64_t key;
+
+public:
+   static uint64_t mix(uint64_t z) {
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      return z ^ (z >> 31);
+   }
+
+   explicit CounterRng(uint64_t seed, uint64_t stream = 0) : key(mix(seed + GOLDEN) ^ mix(stream * GOLDEN + 1)) {}
+
+   uint64_t at(uint64_t counter) const { return mix(key + (counter + 1) * GOLDEN); }
+
+   // Uniform in [0, 1) with 53 random bits
+   double uniform(uint64_t counter) const { return (at(counter) >> 11) * (1.0 / 9007199254740992.0); }
+   double uniform(uint64_t counter, double lo, double hi) const { return lo + (hi - lo) * uniform(counter); }
+};
+
+// Sequential cursor over a CounterRng stream, for code that draws numbers one after another.
+class RngStream {
+private:
+   CounterRng rng;
+   uint64_t counter;
+
+public:
+   RngStream(uint64_t seed, uint64_t stream, uint64_t counter = 0) : rng(seed, stream), counter(counter) {}
+
+   double uniform(double lo, double hi) { return rng.uniform(counter++, lo, hi); }
+   uint64_t position() const { return counter; }
+   void seek(uint64_t position) { counter = position; }
+};
+
+// Seed for callers that did not ask for a reproducible run.
+inline uint64_t randomSeed() {
+   std::random_device rd;
+   return ((uint64_t)rd() << 32) ^ rd();
+}
+
+// Permutation of 0..count-1 for one epoch, a pure function of (seed, epoch): indices are
+// ordered by a random key, with the index breaking ties. Keys are generated in parallel.
+inline std::vector<int> permutation(int count, uint64_t seed, int epoch, int numThreads = 0) {
+   CounterRng rng(seed, 0x5eedull << 32 | (uint32_t)epoch);
+   std::vector<std::pair<uint64_t, int>> keyed(std::max(0, count));
+   if (numThreads <= 0)
+      numThreads = hardwareThreads();
+   parallelFor(count, numThreads, [&](int, int begin, int end) {
+      for (int i = begin; i < end; i++) {
+         keyed[i] = {rng.at(i), i};
+      }
+   });
+   std::sort(keyed.begin(), keyed.end());
+
+   std::vector<int> order(keyed.size());
+   for (size_t i = 0; i < keyed.size(); i++) {
+      order[i] = keyed[i].second;
+   }
+   return order;
+}
+
+#endif
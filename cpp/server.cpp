@@ -0,0 +1,238 @@
+// Local inference daemon. Build with ./build-native.sh, then:
+//   bin/server [model.json] [socket] [--max-batch N] [--max-latency-us N] [--workers N] [--cache N]
+//
+// Requests from all connections go into one queue. A worker takes a batch once
+// max-batch requests are waiting or the oldest one has waited max-latency-us,
+// runs a single batched forward pass and answers every request in it. With --cache,
+// duplicate submissions are answered from an LRU cache of the last N distinct images.
+#include "modeljson.h"
+#include "nn.h"
+#include "parallel.h"
+#include "protocol.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <sys/un.h>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Connection {
+   int fd;
+   std::mutex writeLock;
+
+   explicit Connection(int fd) : fd(fd) {}
+   ~Connection() { close(fd); }
+};
+
+struct Pending {
+   std::shared_ptr<Connection> conn;
+   uint32_t id;
+   Clock::time_point arrived;
+   float pixels[PROTO_NUM_INP];
+};
+
+class Batcher {
+private:
+   std::mutex lock;
+   std::condition_variable ready;
+   std::deque<Pending> queue;
+   size_t maxBatch;
+   Clock::duration maxLatency;
+
+public:
+   Batcher(size_t maxBatch, Clock::duration maxLatency) : maxBatch(maxBatch), maxLatency(maxLatency) {}
+
+   void push(Pending &&p) {
+      std::lock_guard<std::mutex> lk(lock);
+      queue.push_back(std::move(p));
+      ready.notify_one();
+   }
+
+   // Blocks until a batch is due, then moves up to maxBatch requests into batch.
+   void take(std::vector<Pending> &batch) {
+      batch.clear();
+      std::unique_lock<std::mutex> lk(lock);
+      while (true) {
+         ready.wait(lk, [&] { return !queue.empty(); });
+         Clock::time_point deadline = queue.front().arrived + maxLatency;
+         ready.wait_until(lk, deadline, [&] { return queue.size() >= maxBatch; });
+         // Another worker may have drained the queue while we slept.
+         if (!queue.empty())
+            break;
+      }
+
+      size_t n = std::min(queue.size(), maxBatch);
+      for (size_t i = 0; i < n; i++) {
+         batch.push_back(std::move(queue.front()));
+         queue.pop_front();
+      }
+      if (!queue.empty())
+         ready.notify_one();
+   }
+};
+
+// Builds a network from a model.json written by train.js or the Save button. The layer sizes
+// come from the file; loadModelJson then checks every array against them, so a malformed or
+// inconsistent file is rejected here instead of failing inside a worker.
+static std::unique_ptr<NeuralNetwork> loadModel(const std::string &path) {
+   std::ifstream f(path);
+   if (!f)
+      return nullptr;
+   std::stringstream ss;
+   ss << f.rdbuf();
+   std::string text = ss.str();
+
+   std::vector<Matrix> weights, biases;
+   if (!parseModelJson(text, weights, biases))
+      return nullptr;
+
+   std::vector<int> hidden;
+   for (size_t i = 1; i < weights.size(); i++) {
+      hidden.push_back(weights[i].getRows());
+   }
+   auto nn = std::make_unique<NeuralNetwork>(weights[0].getRows(), hidden, weights.back().getCols());
+   if (!nn->loadModelJson(text))
+      return nullptr;
+   return nn;
+}
+
+static void serveConnection(std::shared_ptr<Connection> conn, Batcher &batcher) {
+   InferRequest req;
+   while (readFull(conn->fd, &req, sizeof(req))) {
+      Pending p;
+      p.conn = conn;
+      p.id = req.id;
+      p.arrived = Clock::now();
+      std::memcpy(p.pixels, req.pixels, sizeof(p.pixels));
+      batcher.push(std::move(p));
+   }
+}
+
+static void respond(const Pending &p, const double *probs) {
+   InferResponse res;
+   res.id = p.id;
+   for (int k = 0; k < PROTO_NUM_OUT; k++) {
+      res.probs[k] = probs[k];
+   }
+   // A failed write means the client hung up; its reader thread cleans up.
+   std::lock_guard<std::mutex> lk(p.conn->writeLock);
+   writeFull(p.conn->fd, &res, sizeof(res));
+}
+
+static void runWorker(const NeuralNetwork &nn, Batcher &batcher, InferenceCache *cache) {
+   std::vector<Pending> batch;
+   std::vector<double> inputs;
+   std::vector<InferenceCache::Key> keys;
+   std::vector<double> hit;
+   while (true) {
+      batcher.take(batch);
+
+      // Cached images are answered straight away; the rest are compacted to the front.
+      int n = 0;
+      keys.clear();
+      for (size_t i = 0; i < batch.size(); i++) {
+         if (cache) {
+            InferenceCache::Key key = cache->makeKey(batch[i].pixels, PROTO_NUM_INP);
+            if (cache->lookup(key, nn.getWeightsVersion(), hit)) {
+               respond(batch[i], hit.data());
+               continue;
+            }
+            keys.push_back(std::move(key));
+         }
+         if (n != (int)i)
+            batch[n] = std::move(batch[i]);
+         n++;
+      }
+      if (n == 0) {
+         batch.clear();
+         continue;
+      }
+
+      inputs.resize((size_t)n * PROTO_NUM_INP);
+      for (int b = 0; b < n; b++) {
+         std::copy(batch[b].pixels, batch[b].pixels + PROTO_NUM_INP, inputs.begin() + (size_t)b * PROTO_NUM_INP);
+      }
+      std::vector<double> outputs = nn.predictBatch(inputs, n);
+
+      for (int b = 0; b < n; b++) {
+         const double *probs = outputs.data() + (size_t)b * PROTO_NUM_OUT;
+         if (cache) {
+            cache->insert(std::move(keys[b]), nn.getWeightsVersion(), std::vector<double>(probs, probs + PROTO_NUM_OUT));
+         }
+         respond(batch[b], probs);
+      }
+      batch.clear();
+   }
+}
+
+int main(int argc, char **argv) {
+   std::vector<std::string> positional;
+   int maxBatch = 32;
+   int maxLatencyUs = 2000;
+   int workers = hardwareThreads();
+   int cacheSize = 0;
+   for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg == "--max-batch" && i + 1 < argc)
+         maxBatch = std::atoi(argv[++i]);
+      else if (arg == "--max-latency-us" && i + 1 < argc)
+         maxLatencyUs = std::atoi(argv[++i]);
+      else if (arg == "--workers" && i + 1 < argc)
+         workers = std::atoi(argv[++i]);
+      else if (arg == "--cache" && i + 1 < argc)
+         cacheSize = std::atoi(argv[++i]);
+      else
+         positional.push_back(arg);
+   }
+   std::string modelPath = positional.size() > 0 ? positional[0] : "model.json";
+   std::string socketPath = positional.size() > 1 ? positional[1] : "/tmp/nn-number-rec.sock";
+   maxBatch = std::max(1, maxBatch);
+   workers = std::max(1, workers);
+
+   std::unique_ptr<NeuralNetwork> nn = loadModel(modelPath);
+   if (!nn) {
+      std::fprintf(stderr, "Error: could not load model from %s\n", modelPath.c_str());
+      return 1;
+   }
+   if (nn->getLayerSize(0) != PROTO_NUM_INP || nn->getLayerSize(nn->getNumLayers() - 1) != PROTO_NUM_OUT) {
+      std::fprintf(stderr, "Error: model must map %d inputs to %d outputs\n", PROTO_NUM_INP, PROTO_NUM_OUT);
+      return 1;
+   }
+
+   int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+   sockaddr_un addr{};
+   addr.sun_family = AF_UNIX;
+   std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+   unlink(socketPath.c_str());
+   if (listenFd < 0 || bind(listenFd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenFd, 128) < 0) {
+      std::perror("Error: cannot listen on socket");
+      return 1;
+   }
+
+   Batcher batcher(maxBatch, std::chrono::microseconds(maxLatencyUs));
+   std::unique_ptr<InferenceCache> cache;
+   if (cacheSize > 0)
+      cache.reset(new InferenceCache(cacheSize));
+   for (int i = 0; i < workers; i++) {
+      std::thread(runWorker, std::cref(*nn), std::ref(batcher), cache.get()).detach();
+   }
+   std::printf("Serving %s on %s (max batch %d, max latency %d us, %d workers, cache %d)\n", modelPath.c_str(),
+               socketPath.c_str(), maxBatch, maxLatencyUs, workers, cacheSize);
+
+   while (true) {
+      int fd = accept(listenFd, nullptr, nullptr);
+      if (fd < 0)
+         continue;
+      std::thread(serveConnection, std::make_shared<Connection>(fd), std::ref(batcher)).detach();
+   }
+}
@@ -0,0 +1,209 @@
+#include "sparse.h"
+#include "nn.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+SparseMatrix::SparseMatrix() : rows(0), cols(0), rowPtr(1, 0) {}
+
+SparseMatrix SparseMatrix::fromDense(const MatrixView &m) {
+   if (m.getCols() > 65536) {
+      throw std::invalid_argument("Too many columns for 16-bit sparse indices!");
+   }
+   SparseMatrix s;
+   s.rows = m.getRows();
+   s.cols = m.getCols();
+   s.rowPtr.assign(1, 0);
+   s.rowPtr.reserve(s.rows + 1);
+   for (int i = 0; i < s.rows; i++) {
+      const double *row = m.row(i);
+      for (int j = 0; j < s.cols; j++) {
+         if (row[j] != 0.0) {
+            s.colIdx.push_back(j);
+            s.values.push_back((float)row[j]);
+         }
+      }
+      s.rowPtr.push_back(s.values.size());
+   }
+   return s;
+}
+
+int SparseMatrix::getRows() const { return rows; }
+int SparseMatrix::getCols() const { return cols; }
+int SparseMatrix::getNonZeros() const { return values.size(); }
+
+size_t SparseMatrix::getByteSize() const {
+   return rowPtr.size() * sizeof(uint32_t) + colIdx.size() * sizeof(uint16_t) + values.size() * sizeof(float);
+}
+
+void SparseMatrix::multiply(const Matrix &a, Matrix &out) const {
+   if (a.getCols() != rows) {
+      throw std::invalid_argument("Matrixes are not dot compatible!");
+   }
+   out.resize(a.getRows(), cols);
+   std::fill(out.values(), out.values() + (size_t)a.getRows() * cols, 0.0);
+
+   for (int b = 0; b < a.getRows(); b++) {
+      const double *x = a.values() + (size_t)b * rows;
+      double *y = out.values() + (size_t)b * cols;
+      for (int k = 0; k < rows; k++) {
+         double xk = x[k];
+         if (xk == 0.0)
+            continue;
+         for (uint32_t p = rowPtr[k]; p < rowPtr[k + 1]; p++) {
+            y[colIdx[p]] += xk * values[p];
+         }
+      }
+   }
+}
+
+SparseNetwork::SparseNetwork() {}
+
+SparseNetwork::SparseNetwork(const NeuralNetwork &nn) {
+   int numLayers = nn.getNumLayers();
+   for (int i = 0; i < numLayers; i++) {
+      layerSizes.push_back(nn.getLayerSize(i));
+   }
+   for (int i = 0; i < numLayers - 1; i++) {
+      weights.push_back(SparseMatrix::fromDense(nn.getWeights(i)));
+      MatrixView b = nn.getBiases(i);
+      biases.emplace_back(b.values(), b.values() + b.getCols());
+   }
+}
+
+std::vector<double> SparseNetwork::predictBatch(const std::vector<double> &inputs, int batchSize) const {
+   if (layerSizes.empty())
+      return {};
+   int inputSize = layerSizes[0];
+   int outputSize = layerSizes.back();
+   if (batchSize <= 0 || inputs.size() < (size_t)batchSize * inputSize)
+      return {};
+
+   Matrix a(batchSize, inputSize, std::vector<double>(inputs.begin(), inputs.begin() + (size_t)batchSize * inputSize));
+   Matrix z(0, 0);
+   for (size_t i = 0; i < weights.size(); i++) {
+      weights[i].multiply(a, z);
+      int cols = z.getCols();
+      for (int r = 0; r < batchSize; r++) {
+         double *row = z.values() + (size_t)r * cols;
+         for (int j = 0; j < cols; j++) {
+            row[j] = 1.0 / (1.0 + std::exp(-(row[j] + biases[i][j])));
+         }
+      }
+      std::swap(a, z);
+   }
+   return std::vector<double>(a.values(), a.values() + (size_t)batchSize * outputSize);
+}
+
+int SparseNetwork::getNonZeros() const {
+   int n = 0;
+   for (const SparseMatrix &w : weights) {
+      n += w.getNonZeros();
+   }
+   return n;
+}
+
+size_t SparseNetwork::getByteSize() const {
+   size_t n = 0;
+   for (size_t i = 0; i < weights.size(); i++) {
+      n += weights[i].getByteSize() + biases[i].size() * sizeof(double);
+   }
+   return n;
+}
+
+// Layout (host byte order): "NNSP" u32 version, u32 numLayers, u32 layerSizes[numLayers],
+// then per layer: u32 nnz, u32 rowPtr[in + 1], u16 colIdx[nnz], f32 values[nnz], f64 bias[out].
+// Biases stay f64 (as in memory), so a loaded model predicts exactly like the one saved.
+static const char SPARSE_MAGIC[4] = {'N', 'N', 'S', 'P'};
+static const uint32_t SPARSE_VERSION = 2;
+
+static void putBytes(std::vector<uint8_t> &out, const void *p, size_t n) {
+   size_t at = out.size();
+   out.resize(at + n);
+   std::memcpy(out.data() + at, p, n);
+}
+
+static bool getBytes(const uint8_t *&p, const uint8_t *end, void *dst, size_t n) {
+   if ((size_t)(end - p) < n)
+      return false;
+   if (n > 0)
+      std::memcpy(dst, p, n); // dst is null for an empty layer
+   p += n;
+   return true;
+}
+
+std::vector<uint8_t> SparseNetwork::serialize() const {
+   std::vector<uint8_t> out;
+   putBytes(out, SPARSE_MAGIC, 4);
+   putBytes(out, &SPARSE_VERSION, 4);
+   uint32_t numLayers = layerSizes.size();
+   putBytes(out, &numLayers, 4);
+   for (int size : layerSizes) {
+      uint32_t s = size;
+      putBytes(out, &s, 4);
+   }
+   for (size_t i = 0; i < weights.size(); i++) {
+      const SparseMatrix &w = weights[i];
+      uint32_t nnz = w.values.size();
+      putBytes(out, &nnz, 4);
+      putBytes(out, w.rowPtr.data(), w.rowPtr.size() * sizeof(uint32_t));
+      putBytes(out, w.colIdx.data(), nnz * sizeof(uint16_t));
+      putBytes(out, w.values.data(), nnz * sizeof(float));
+      putBytes(out, biases[i].data(), biases[i].size() * sizeof(double));
+   }
+   return out;
+}
+
+bool SparseNetwork::deserialize(const uint8_t *bytes, size_t size, SparseNetwork &out) {
+   const uint8_t *p = bytes;
+   const uint8_t *end = bytes + size;
+   char magic[4];
+   uint32_t version, numLayers;
+   if (!getBytes(p, end, magic, 4) || std::memcmp(magic, SPARSE_MAGIC, 4) != 0 || !getBytes(p, end, &version, 4) ||
+       version != SPARSE_VERSION || !getBytes(p, end, &numLayers, 4) || numLayers < 2)
+      return false;
+   // Every size read from the file is checked against the bytes left before it allocates.
+   if ((size_t)(end - p) / 4 < numLayers)
+      return false;
+
+   out = SparseNetwork();
+   out.layerSizes.resize(numLayers);
+   for (uint32_t i = 0; i < numLayers; i++) {
+      uint32_t s;
+      // Column indices are 16-bit
+      if (!getBytes(p, end, &s, 4) || s == 0 || s > 65536)
+         return false;
+      out.layerSizes[i] = s;
+   }
+   for (uint32_t i = 0; i < numLayers - 1; i++) {
+      SparseMatrix w;
+      w.rows = out.layerSizes[i];
+      w.cols = out.layerSizes[i + 1];
+      uint32_t nnz;
+      if (!getBytes(p, end, &nnz, 4) || nnz > (uint64_t)w.rows * w.cols ||
+          (uint64_t)(end - p) < (uint64_t)(w.rows + 1) * 4 + (uint64_t)nnz * 6 + (uint64_t)w.cols * 8)
+         return false;
+      w.rowPtr.resize(w.rows + 1);
+      w.colIdx.resize(nnz);
+      w.values.resize(nnz);
+      std::vector<double> b(w.cols);
+      if (!getBytes(p, end, w.rowPtr.data(), w.rowPtr.size() * sizeof(uint32_t)) ||
+          !getBytes(p, end, w.colIdx.data(), nnz * sizeof(uint16_t)) ||
+          !getBytes(p, end, w.values.data(), nnz * sizeof(float)) || !getBytes(p, end, b.data(), b.size() * sizeof(double)))
+         return false;
+      // Reject indices that would read or write out of bounds in multiply()
+      if (w.rowPtr[0] != 0 || w.rowPtr[w.rows] != nnz)
+         return false;
+      for (int r = 0; r < w.rows; r++) {
+         if (w.rowPtr[r] > w.rowPtr[r + 1])
+            return false;
+      }
+      for (uint16_t c : w.colIdx) {
+         if (c >= w.cols)
+            return false;
+      }
+      out.weights.push_back(std::move(w));
+      out.biases.push_back(std::move(b));
+   }
+   return p == end;
+}
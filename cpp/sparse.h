@@ -0,0 +1,56 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include "matrix.h"
+#include <cstdint>
+#include <vector>
+
+class NeuralNetwork;
+
+// Compressed sparse row storage for a pruned (in x out) weight matrix. Values are kept
+// as float and column indices as uint16, 6 bytes per non-zero instead of 8 per weight.
+class SparseMatrix {
+private:
+   int rows;
+   int cols;
+   std::vector<uint32_t> rowPtr; // rows + 1 offsets into colIdx/values
+   std::vector<uint16_t> colIdx;
+   std::vector<float> values;
+
+   friend class SparseNetwork;
+
+public:
+   SparseMatrix();
+   static SparseMatrix fromDense(const MatrixView &m); // Keeps only the non-zero entries
+
+   int getRows() const;
+   int getCols() const;
+   int getNonZeros() const;
+   size_t getByteSize() const;
+
+   // out = a * this. Zero inputs are skipped as well as pruned weights, so blank pixels cost nothing.
+   void multiply(const Matrix &a, Matrix &out) const;
+};
+
+// Inference-only copy of a pruned NeuralNetwork with CSR weights.
+class SparseNetwork {
+private:
+   std::vector<int> layerSizes;
+   std::vector<SparseMatrix> weights;
+   std::vector<std::vector<double>> biases;
+
+public:
+   SparseNetwork();
+   explicit SparseNetwork(const NeuralNetwork &nn);
+
+   // Same contract as NeuralNetwork::predictBatch.
+   std::vector<double> predictBatch(const std::vector<double> &inputs, int batchSize) const;
+
+   int getNonZeros() const;
+   size_t getByteSize() const; // In-memory footprint of weights and biases
+
+   std::vector<uint8_t> serialize() const;
+   static bool deserialize(const uint8_t *bytes, size_t size, SparseNetwork &out);
+};
+
+#endif
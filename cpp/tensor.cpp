@@ -0,0 +1,317 @@
+#include "tensor.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+static size_t sizeFromShape(const std::vector<int> &shape) {
+   if (shape.empty())
+      return 0;
+   size_t size = 1;
+   for (int dim : shape)
+      size *= dim;
+   return size;
+}
+
+static std::vector<long> contiguousStrides(const std::vector<int> &shape) {
+   std::vector<long> strides(shape.size());
+   long stride = 1;
+   for (int i = (int)shape.size() - 1; i >= 0; i--) {
+      strides[i] = stride;
+      stride *= shape[i];
+   }
+   return strides;
+}
+
+Tensor::Tensor() : storage(std::make_shared<std::vector<double>>()) {}
+
+Tensor::Tensor(const std::vector<int> &shape)
+    : storage(std::make_shared<std::vector<double>>(sizeFromShape(shape), 0.0)), shape(shape),
+      strides(contiguousStrides(shape)) {
+   for (int dim : shape) {
+      if (dim < 0)
+         throw std::invalid_argument("Negative tensor dimension");
+   }
+}
+
+Tensor::Tensor(const std::vector<int> &shape, std::vector<double> &&data)
+    : storage(std::make_shared<std::vector<double>>(std::move(data))), shape(shape), strides(contiguousStrides(shape)) {
+   if (storage->size() != sizeFromShape(shape)) {
+      throw std::invalid_argument("Data size does not match the tensor shape");
+   }
+}
+
+std::vector<int> Tensor::getShape() const { return shape; }
+
+std::vector<long> Tensor::getStrides() const { return strides; }
+
+int Tensor::rank() const { return shape.size(); }
+
+size_t Tensor::size() const { return sizeFromShape(shape); }
+
+bool Tensor::isContiguous() const {
+   long expected = 1;
+   for (int i = (int)shape.size() - 1; i >= 0; i--) {
+      if (shape[i] > 1 && strides[i] != expected)
+         return false;
+      expected *= shape[i];
+   }
+   return true;
+}
+
+const double *Tensor::values() const { return storage->data() + offset; }
+
+double *Tensor::values() { return storage->data() + offset; }
+
+std::vector<double> Tensor::getData() const {
+   size_t n = size();
+   if (isContiguous()) {
+      return std::vector<double>(values(), values() + n);
+   }
+   // Walk the indices in row-major order, odometer style
+   std::vector<double> out;
+   out.reserve(n);
+   std::vector<int> idx(shape.size(), 0);
+   const double *base = values();
+   for (size_t k = 0; k < n; k++) {
+      long at = 0;
+      for (size_t d = 0; d < shape.size(); d++) {
+         at += idx[d] * strides[d];
+      }
+      out.push_back(base[at]);
+      for (int d = (int)shape.size() - 1; d >= 0 && ++idx[d] == shape[d]; d--) {
+         idx[d] = 0;
+      }
+   }
+   return out;
+}
+
+size_t Tensor::flatIndex(const std::vector<int> &indices) const {
+   if (indices.size() != shape.size())
+      throw std::out_of_range("Index dimension mismatch");
+   long at = offset;
+   for (size_t d = 0; d < shape.size(); d++) {
+      if (indices[d] < 0 || indices[d] >= shape[d])
+         throw std::out_of_range("Index out of bounds");
+      at += indices[d] * strides[d];
+   }
+   return at;
+}
+
+double Tensor::get(const std::vector<int> &indices) const { return (*storage)[flatIndex(indices)]; }
+
+void Tensor::set(const std::vector<int> &indices, double value) { (*storage)[flatIndex(indices)] = value; }
+
+Tensor Tensor::slice(int start, int end) const {
+   if (shape.empty())
+      return *this;
+
+   int dim0 = shape[0];
+   if (start < 0)
+      start += dim0;
+   if (end < 0)
+      end += dim0;
+   start = std::max(0, std::min(start, dim0));
+   end = std::max(start, std::min(end, dim0));
+   return narrow(0, start, end);
+}
+
+Tensor Tensor::slice(int start) const {
+   if (shape.empty())
+      return *this;
+   return slice(start, shape[0]);
+}
+
+Tensor Tensor::narrow(int axis, int start, int end) const {
+   if (axis < 0 || axis >= rank())
+      throw std::out_of_range("Axis out of range");
+   if (start < 0 || end < start || end > shape[axis])
+      throw std::out_of_range("Range out of bounds");
+   Tensor t = *this;
+   t.offset += start * strides[axis];
+   t.shape[axis] = end - start;
+   return t;
+}
+
+Tensor Tensor::transpose() const {
+   Tensor t = *this;
+   std::reverse(t.shape.begin(), t.shape.end());
+   std::reverse(t.strides.begin(), t.strides.end());
+   return t;
+}
+
+Tensor Tensor::permute(const std::vector<int> &axes) const {
+   if (axes.size() != shape.size())
+      throw std::invalid_argument("Permutation needs one entry per axis");
+   std::vector<bool> seen(axes.size(), false);
+   Tensor t = *this;
+   for (size_t i = 0; i < axes.size(); i++) {
+      int a = axes[i];
+      if (a < 0 || a >= rank() || seen[a])
+         throw std::invalid_argument("Invalid permutation");
+      seen[a] = true;
+      t.shape[i] = shape[a];
+      t.strides[i] = strides[a];
+   }
+   return t;
+}
+
+Tensor Tensor::reshape(const std::vector<int> &newShape) const {
+   std::vector<int> resolved = newShape;
+   size_t known = 1;
+   int infer = -1;
+   for (size_t i = 0; i < resolved.size(); i++) {
+      if (resolved[i] == -1 && infer < 0) {
+         infer = i;
+      } else if (resolved[i] < 0) {
+         throw std::invalid_argument("Invalid reshape dimension");
+      } else {
+         known *= resolved[i];
+      }
+   }
+   if (infer >= 0) {
+      if (known == 0 || size() % known != 0)
+         throw std::invalid_argument("Cannot infer reshape dimension");
+      resolved[infer] = size() / known;
+   }
+   if (sizeFromShape(resolved) != size())
+      throw std::invalid_argument("Reshape must keep the number of elements");
+
+   Tensor t = contiguous();
+   t.shape = resolved;
+   t.strides = contiguousStrides(resolved);
+   return t;
+}
+
+Tensor Tensor::contiguous() const { return isContiguous() ? *this : clone(); }
+
+Tensor Tensor::clone() const { return Tensor(shape, getData()); }
+
+MatrixView Tensor::asMatrix() const {
+   if (rank() == 1 && (shape[0] <= 1 || strides[0] == 1))
+      return MatrixView(values(), 1, shape[0], shape[0]);
+   if (rank() != 2 || (shape[1] > 1 && strides[1] != 1))
+      throw std::invalid_argument("asMatrix needs a 2-d tensor with contiguous rows");
+   return MatrixView(values(), shape[0], shape[1], strides[0]);
+}
+
+void Tensor::detach() {
+   if (storage.use_count() == 1 && offset == 0 && isContiguous() && storage->size() == size())
+      return;
+   storage = std::make_shared<std::vector<double>>(getData());
+   offset = 0;
+   strides = contiguousStrides(shape);
+}
+
+// Inserts one axis-0 item (shape shape[1:], given row-major) before index.
+static void insertItem(std::vector<int> &shape, std::vector<double> &data, int index, const std::vector<int> &itemShape,
+                       const std::vector<double> &item) {
+   if (!std::equal(shape.begin() + 1, shape.end(), itemShape.begin(), itemShape.end()))
+      throw std::invalid_argument("Item shape does not match tensor dimensions");
+   if (index < 0 || index > shape[0])
+      throw std::out_of_range("Index out of bounds");
+   size_t rowSize = std::max<size_t>(1, sizeFromShape(itemShape));
+   data.insert(data.begin() + index * rowSize, item.begin(), item.end());
+   shape[0]++;
+}
+
+void Tensor::insert(int index, const Tensor &item) {
+   std::vector<int> itemShape = item.shape;
+   if (shape.size() == 1 && item.shape == std::vector<int>{1})
+      itemShape.clear(); // A single element is the item of a 1-d tensor
+   if (shape.empty()) {
+      shape.assign(1, 0);
+      shape.insert(shape.end(), itemShape.begin(), itemShape.end());
+      strides = contiguousStrides(shape);
+   }
+   detach();
+   insertItem(shape, *storage, index, itemShape, item.getData());
+   strides = contiguousStrides(shape);
+}
+
+void Tensor::push(const Tensor &item) { insert(shape.empty() ? 0 : shape[0], item); }
+
+void Tensor::pop() {
+   if (shape.empty() || shape[0] == 0)
+      return;
+   detach();
+   size_t rowSize = size() / shape[0];
+   storage->resize(storage->size() - rowSize);
+   shape[0]--;
+}
+
+void Tensor::show() const {
+   std::cout << "Tensor shape: [";
+   for (size_t i = 0; i < shape.size(); ++i) {
+      std::cout << shape[i] << (i < shape.size() - 1 ? ", " : "");
+   }
+   std::cout << "], size: " << size() << (isContiguous() ? "" : " (strided view)") << std::endl;
+}
+
+#ifdef __EMSCRIPTEN__
+// Parses a nested JS array into row-major data, checking that it is not ragged.
+static void parseRecursive(emscripten::val v, std::vector<double> &data, std::vector<int> &shape, size_t dim) {
+   unsigned int len = v["length"].as<unsigned int>();
+
+   if (shape.size() <= dim) {
+      shape.push_back(len);
+   } else if (shape[dim] != (int)len) {
+      throw std::invalid_argument("Ragged arrays are not supported");
+   }
+
+   if (len == 0)
+      return;
+
+   emscripten::val first = v[0];
+   bool isArray = (first.typeOf().as<std::string>() == "object") && !first["length"].isUndefined();
+
+   if (isArray) {
+      for (unsigned int i = 0; i < len; ++i) {
+         parseRecursive(v[i], data, shape, dim + 1);
+      }
+   } else {
+      for (unsigned int i = 0; i < len; ++i) {
+         data.push_back(v[i].as<double>());
+      }
+   }
+}
+
+static std::vector<int> valToVecInt(emscripten::val v) {
+   if (v.typeOf().as<std::string>() != "object" || v["length"].isUndefined()) {
+      throw std::invalid_argument("Indices must be an array");
+   }
+   unsigned int length = v["length"].as<unsigned int>();
+   std::vector<int> vec;
+   vec.reserve(length);
+   for (unsigned int i = 0; i < length; ++i) {
+      vec.push_back(v[i].as<int>());
+   }
+   return vec;
+}
+
+Tensor::Tensor(emscripten::val jsArray) : Tensor() {
+   if (jsArray.typeOf().as<std::string>() != "object" || jsArray["length"].isUndefined()) {
+      throw std::invalid_argument("Input must be an array");
+   }
+   parseRecursive(jsArray, *storage, shape, 0);
+   strides = contiguousStrides(shape);
+}
+
+double Tensor::get(emscripten::val indices) const { return get(valToVecInt(indices)); }
+
+void Tensor::set(emscripten::val indices, double value) { set(valToVecInt(indices), value); }
+
+void Tensor::insert(int index, emscripten::val item) {
+   if (item.typeOf().as<std::string>() == "number") {
+      if (shape.empty()) {
+         // Numbers pushed onto an empty tensor make it 1-d
+         shape.assign(1, 0);
+         strides.assign(1, 1);
+      }
+      insert(index, Tensor({1}, std::vector<double>{item.as<double>()}));
+   } else {
+      insert(index, Tensor(item));
+   }
+}
+
+void Tensor::push(emscripten::val item) { insert(shape.empty() ? 0 : shape[0], item); }
+#endif
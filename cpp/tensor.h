@@ -0,0 +1,75 @@
+#ifndef TENSOR_H
+#define TENSOR_H
+
+#include "matrix.h"
+#ifdef __EMSCRIPTEN__
+#include <emscripten/val.h>
+#endif
+#include <memory>
+#include <vector>
+
+// N-d array over shared, reference-counted storage. A tensor is a view: an offset plus a
+// shape and per-axis strides (in elements). slice, narrow, transpose, permute and reshape of a
+// contiguous tensor return views onto the same storage without copying, so writes through one
+// view are seen by all of them and the storage lives as long as any view does.
+class Tensor {
+private:
+   std::shared_ptr<std::vector<double>> storage;
+   size_t offset = 0;
+   std::vector<int> shape;
+   std::vector<long> strides;
+
+   size_t flatIndex(const std::vector<int> &indices) const;
+   void detach(); // Gives this tensor its own contiguous storage (copy-on-write for push/insert/pop)
+
+public:
+   Tensor();
+   explicit Tensor(const std::vector<int> &shape); // Zero-filled
+   Tensor(const std::vector<int> &shape, std::vector<double> &&data); // Takes row-major storage without copying
+#ifdef __EMSCRIPTEN__
+   Tensor(emscripten::val jsArray); // From a nested JS array
+#endif
+
+   std::vector<int> getShape() const;
+   std::vector<long> getStrides() const;
+   std::vector<double> getData() const; // Row-major copy
+   int rank() const;
+   size_t size() const;
+   bool isContiguous() const; // Row-major with no gaps
+
+   // Pointer to the first element; valid until push/insert/pop reallocate the storage.
+   const double *values() const;
+   double *values();
+
+   double get(const std::vector<int> &indices) const;
+   void set(const std::vector<int> &indices, double value);
+
+   // Views sharing storage
+   Tensor slice(int start, int end) const; // Axis 0, negative indices count from the end
+   Tensor slice(int start) const;
+   Tensor narrow(int axis, int start, int end) const;
+   Tensor transpose() const;                        // Reverses the axes
+   Tensor permute(const std::vector<int> &axes) const;
+   Tensor reshape(const std::vector<int> &newShape) const; // One -1 is inferred; copies only if not contiguous
+
+   Tensor contiguous() const; // Itself if already contiguous, otherwise a row-major copy
+   Tensor clone() const;      // Always a copy
+
+   // 2-d view as a MatrixView (rows may be strided); throws unless the last axis has stride 1.
+   MatrixView asMatrix() const;
+
+   // Array-like operations on axis 0. Other views keep seeing the data they had.
+   void push(const Tensor &item);
+   void insert(int index, const Tensor &item);
+   void pop();
+#ifdef __EMSCRIPTEN__
+   double get(emscripten::val indices) const;
+   void set(emscripten::val indices, double value);
+   void push(emscripten::val item);
+   void insert(int index, emscripten::val item);
+#endif
+
+   void show() const;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "trainer.h"
+#include "rng.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+static const int VALIDATION_BATCH = 256;
+
+Trainer::Trainer(NeuralNetwork &nn, int trainCount, const TrainerConfig &config)
+    : nn(nn), config(config), trainCount(trainCount), bestLoss(std::numeric_limits<double>::infinity()),
+      start(std::chrono::steady_clock::now()) {
+   if (trainCount <= 0 || config.batchSize <= 0 || config.maxEpochs <= 0 || config.validateEvery <= 0) {
+      throw std::invalid_argument("Trainer needs positive trainCount, batchSize, maxEpochs and validateEvery!");
+   }
+   nextValidation = config.validateEvery;
+   // Networks from before lrStep held the base rate start from their current rate
+   if (nn.getLrStep() <= 0) {
+      nn.setLrStep(nn.getLrnRate());
+   }
+}
+
+void Trainer::setValidation(const std::vector<double> &inputs, const std::vector<double> &targets, int count) {
+   int inSize = nn.getLayerSize(0);
+   int outSize = nn.getLayerSize(nn.getNumLayers() - 1);
+   if (count < 0 || inputs.size() < (size_t)count * inSize || targets.size() < (size_t)count * outSize) {
+      throw std::invalid_argument("Validation data is smaller than count!");
+   }
+   valCount = count;
+   valInputs.assign(inputs.begin(), inputs.begin() + (size_t)count * inSize);
+   valTargets.assign(targets.begin(), targets.begin() + (size_t)count * outSize);
+   valLabels.resize(count);
+   for (int i = 0; i < count; i++) {
+      const double *t = &valTargets[(size_t)i * outSize];
+      valLabels[i] = std::max_element(t, t + outSize) - t;
+   }
+}
+
+void Trainer::setPosition(int epoch, int cursor) {
+   samples = (long long)epoch * trainCount + cursor;
+   nextValidation = (samples / config.validateEvery + 1) * config.validateEvery;
+}
+
+void Trainer::snapshot(Checkpoint &out) const {
+   nn.snapshot(out);
+   out.epoch = samples / trainCount;
+   out.cursor = samples % trainCount;
+   out.bestLoss = bestLoss;
+   out.stale = stale;
+   out.reductions = reductions;
+   out.trainSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool Trainer::restore(const Checkpoint &ckpt) {
+   if (!nn.restore(ckpt))
+      return false;
+   setPosition(ckpt.epoch, ckpt.cursor);
+   bestLoss = ckpt.bestLoss;
+   stale = ckpt.stale;
+   reductions = ckpt.reductions;
+   reason = StopReason::Running;
+   timeToTarget = -1;
+   history.clear();
+   auto trained = std::chrono::duration<double>(ckpt.trainSeconds);
+   start = std::chrono::steady_clock::now() - std::chrono::duration_cast<std::chrono::steady_clock::duration>(trained);
+   return true;
+}
+
+double Trainer::scheduledRate() const {
+   double base = nn.getLrStep();
+   double epoch = getEpoch();
+   switch (config.schedule) {
+   case LrSchedule::Step:
+      return base * std::pow(config.decay, std::floor(epoch / std::max(1, config.stepEpochs)));
+   case LrSchedule::Cosine: {
+      double t = std::min(1.0, epoch / config.maxEpochs);
+      double floor = std::min(config.minRate, base);
+      return floor + (base - floor) * 0.5 * (1.0 + std::cos(M_PI * t));
+   }
+   case LrSchedule::Plateau:
+      return base * std::pow(config.decay, reductions);
+   default:
+      return base;
+   }
+}
+
+bool Trainer::trainBatch(const std::vector<double> &inputs, const std::vector<double> &targets, int batchSize) {
+   if (reason != StopReason::Running)
+      return false;
+
+   nn.setLrnRate(scheduledRate());
+   nn.trainBatch(inputs, targets, batchSize);
+   samples += batchSize;
+
+   bool finished = samples >= (long long)config.maxEpochs * trainCount;
+   if (valCount > 0 && (samples >= nextValidation || finished)) {
+      nextValidation = (samples / config.validateEvery + 1) * config.validateEvery;
+      afterValidation(validate());
+   }
+   if (finished && reason == StopReason::Running) {
+      reason = StopReason::MaxEpochs;
+   }
+   return reason == StopReason::Running;
+}
+
+void Trainer::afterValidation(const Validation &v) {
+   history.push_back(v);
+
+   if (config.targetAccuracy > 0 && v.accuracy >= config.targetAccuracy) {
+      timeToTarget = v.seconds;
+      reason = StopReason::TargetReached;
+      return;
+   }
+
+   if (v.loss < bestLoss - config.minDelta) {
+      bestLoss = v.loss;
+      stale = 0;
+      return;
+   }
+   if (++stale < config.patience)
+      return;
+
+   // Plateau: the Plateau schedule decays the rate and keeps going while it stays above minRate.
+   stale = 0;
+   double nextRate = nn.getLrStep() * std::pow(config.decay, reductions + 1);
+   if (config.schedule == LrSchedule::Plateau && nextRate >= config.minRate) {
+      reductions++;
+   } else {
+      reason = StopReason::Plateau;
+   }
+}
+
+StopReason Trainer::fit(const std::vector<double> &inputs, const std::vector<double> &targets, unsigned int seed) {
+   int inSize = nn.getLayerSize(0);
+   int outSize = nn.getLayerSize(nn.getNumLayers() - 1);
+   if (inputs.size() < (size_t)trainCount * inSize || targets.size() < (size_t)trainCount * outSize) {
+      throw std::invalid_argument("Training data is smaller than trainCount!");
+   }
+
+   std::vector<double> batchIn, batchTgt;
+   while (reason == StopReason::Running) {
+      int epoch = samples / trainCount;
+      int cursor = samples % trainCount;
+      std::vector<int> order = permutation(trainCount, seed, epoch);
+      for (int i = cursor; i < trainCount && reason == StopReason::Running; i += config.batchSize) {
+         int batch = std::min(config.batchSize, trainCount - i);
+         batchIn.resize((size_t)batch * inSize);
+         batchTgt.resize((size_t)batch * outSize);
+         for (int j = 0; j < batch; j++) {
+            size_t idx = order[i + j];
+            std::copy(inputs.begin() + idx * inSize, inputs.begin() + (idx + 1) * inSize,
+                      batchIn.begin() + (size_t)j * inSize);
+            std::copy(targets.begin() + idx * outSize, targets.begin() + (idx + 1) * outSize,
+                      batchTgt.begin() + (size_t)j * outSize);
+         }
+         trainBatch(batchIn, batchTgt, batch);
+      }
+   }
+   return reason;
+}
+
+Validation Trainer::validate() const {
+   int inSize = nn.getLayerSize(0);
+   int outSize = nn.getLayerSize(nn.getNumLayers() - 1);
+   int correct = 0;
+   double sqErr = 0;
+
+   std::vector<double> chunk;
+   for (int begin = 0; begin < valCount; begin += VALIDATION_BATCH) {
+      int batch = std::min(VALIDATION_BATCH, valCount - begin);
+      chunk.assign(valInputs.begin() + (size_t)begin * inSize, valInputs.begin() + (size_t)(begin + batch) * inSize);
+      std::vector<double> out = nn.predictBatch(chunk, batch);
+      for (int r = 0; r < batch; r++) {
+         const double *o = &out[(size_t)r * outSize];
+         const double *t = &valTargets[(size_t)(begin + r) * outSize];
+         for (int k = 0; k < outSize; k++) {
+            sqErr += (t[k] - o[k]) * (t[k] - o[k]);
+         }
+         correct += std::max_element(o, o + outSize) - o == valLabels[begin + r];
+      }
+   }
+
+   Validation v;
+   v.epoch = getEpoch();
+   v.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+   v.accuracy = valCount > 0 ? (double)correct / valCount : 0;
+   v.loss = valCount > 0 ? sqErr / ((double)valCount * outSize) : 0;
+   v.lrnRate = nn.getLrnRate();
+   return v;
+}
+
+StopReason Trainer::getStopReason() const { return reason; }
+
+double Trainer::getEpoch() const { return (double)samples / trainCount; }
+
+double Trainer::getTimeToTarget() const { return timeToTarget; }
+
+const std::vector<Validation> &Trainer::getHistory() const { return history; }
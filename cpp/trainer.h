@@ -0,0 +1,92 @@
+#ifndef TRAINER_H
+#define TRAINER_H
+
+#include "nn.h"
+#include <chrono>
+#include <vector>
+
+// How the learning rate moves away from the base rate (NeuralNetwork::lrStep).
+enum class LrSchedule { Constant, Step, Cosine, Plateau };
+
+enum class StopReason { Running, TargetReached, Plateau, MaxEpochs };
+
+struct TrainerConfig {
+   LrSchedule schedule = LrSchedule::Cosine;
+   int batchSize = 1;
+   int maxEpochs = 10;
+   int validateEvery = 10000;  // Training samples between validations
+   double targetAccuracy = 0;  // Stop once validation accuracy (0..1) reaches this; 0 disables
+   int patience = 3;           // Validations without loss improvement that count as a plateau
+   double minDelta = 1e-4;     // Smallest loss decrease that counts as improvement
+   double decay = 0.5;         // Rate multiplier for Step (every stepEpochs) and Plateau (per plateau)
+   int stepEpochs = 1;
+   double minRate = 1e-3;      // Cosine floor; Plateau stops instead of decaying below it
+};
+
+// One validation pass over the held-out split.
+struct Validation {
+   double epoch;    // Fractional epochs trained so far
+   double seconds;  // Wall-clock time since the trainer started
+   double accuracy; // 0..1
+   double loss;     // Mean squared error per output
+   double lrnRate;
+};
+
+// Drives a NeuralNetwork towards a target accuracy as fast as possible: sets the learning
+// rate from the schedule before every batch, validates every validateEvery samples with
+// batched inference and reports when to stop. The network must outlive the trainer.
+class Trainer {
+private:
+   NeuralNetwork &nn;
+   TrainerConfig config;
+   int trainCount;
+
+   std::vector<double> valInputs;
+   std::vector<double> valTargets;
+   std::vector<int> valLabels;
+   int valCount = 0;
+
+   long long samples = 0;
+   long long nextValidation;
+   double bestLoss;
+   int stale = 0;      // Validations since bestLoss improved
+   int reductions = 0; // Plateau decays applied so far
+   StopReason reason = StopReason::Running;
+   double timeToTarget = -1;
+   std::vector<Validation> history;
+   std::chrono::steady_clock::time_point start;
+
+   double scheduledRate() const;
+   void afterValidation(const Validation &v);
+
+public:
+   // trainCount is the epoch length used for the schedule and the epoch limit.
+   Trainer(NeuralNetwork &nn, int trainCount, const TrainerConfig &config = TrainerConfig());
+
+   // Copies the held-out split: count row-major inputs and one-hot targets.
+   void setValidation(const std::vector<double> &inputs, const std::vector<double> &targets, int count);
+
+   // Continues a resumed run from the given position (e.g. a checkpoint's epoch and cursor).
+   void setPosition(int epoch, int cursor);
+
+   // Network snapshot plus the trainer's position, plateau tracking and elapsed time; the caller sets rngState.
+   void snapshot(Checkpoint &out) const;
+   // Restores the network and the trainer state from a checkpoint. Returns false if the network shape differs.
+   bool restore(const Checkpoint &ckpt);
+
+   // Trains one batch at the scheduled rate, validating when due. Returns false once training should stop.
+   bool trainBatch(const std::vector<double> &inputs, const std::vector<double> &targets, int batchSize);
+
+   // Whole run on the first trainCount samples: shuffled epochs (permutation of seed, epoch)
+   // in batches of config.batchSize until a stop condition. Returns the reason.
+   StopReason fit(const std::vector<double> &inputs, const std::vector<double> &targets, unsigned int seed);
+
+   Validation validate() const;
+
+   StopReason getStopReason() const;
+   double getEpoch() const;
+   double getTimeToTarget() const; // Seconds until targetAccuracy was reached, -1 if not (yet)
+   const std::vector<Validation> &getHistory() const;
+};
+
+#endif
@@ -1,5 +1,11 @@
+#include "gemm.h"
 #include "matrix.h"
 #include "nn.h"
+#include "online.h"
+#include "rng.h"
+#include "sparse.h"
+#include "tensor.h"
+#include "trainer.h"
 #include <emscripten/bind.h>
 #include <numeric>
 #include <vector>
@@ -37,29 +43,262 @@ EMSCRIPTEN_BINDINGS(my_module) {
        .function("at", select_overload<const double &(int, int) const>(&Matrix::at))
        .function("show", &Matrix::show)
        .function("clone", &Matrix::clone)
-       .class_function("dot", &Matrix::dot)
-       .class_function("subtract", &Matrix::subtract)
+       .function("view", &Matrix::view)
+       .class_function("dot", select_overload<Matrix(const Matrix &, const Matrix &)>(&Matrix::dot))
+       .class_function("subtract", select_overload<Matrix(const Matrix &, const Matrix &)>(&Matrix::subtract))
        .class_function("multiply", select_overload<Matrix(const Matrix &, const Matrix &)>(&Matrix::multiply))
-       .class_function("transpose", &Matrix::transpose)
-       .class_function("convertFromArray", &Matrix::convertFromArray);
+       .class_function("transpose", select_overload<Matrix(const Matrix &)>(&Matrix::transpose))
+       .class_function("convertFromArray", select_overload<Matrix(const std::vector<double> &)>(&Matrix::convertFromArray));
+
+   // GEMM kernel tuning (see gemm.h). There is no file system here, so JS keeps the exported
+   // cache (e.g. in localStorage) and imports it at startup.
+   function("gemmTarget", optional_override([]() { return std::string(GemmTuner::target()); }));
+   function("setGemmAutotune", optional_override([](bool on) { GemmTuner::instance().setAutotune(on); }));
+   function("exportGemmCache", optional_override([]() { return GemmTuner::instance().exportCache(); }));
+   function("importGemmCache",
+            optional_override([](const std::string &text) { return GemmTuner::instance().importCache(text); }));
+
+   // Read-only window onto engine-owned storage; same getRows/getCols/at API as Matrix.
+   class_<MatrixView>("MatrixView")
+       .function("getRows", &MatrixView::getRows)
+       .function("getCols", &MatrixView::getCols)
+       .function("at", &MatrixView::at)
+       .function("toMatrix", &MatrixView::toMatrix)
+       .function("toArray", optional_override([](const MatrixView &self) {
+                    // Float64Array aliasing the wasm heap: no copy, but invalid after the heap grows
+                    if (self.getStride() != self.getCols())
+                       return val::null();
+                    return val(typed_memory_view((size_t)self.getRows() * self.getCols(), self.values()));
+                 }));
+
+   // Strided N-d array; slice/narrow/transpose/permute/reshape return views sharing storage.
+   class_<Tensor>("Tensor")
+       .constructor<emscripten::val>()
+       .function("getShape", &Tensor::getShape)
+       .function("getStrides", optional_override([](const Tensor &self) {
+                    std::vector<long> s = self.getStrides();
+                    return std::vector<int>(s.begin(), s.end());
+                 }))
+       .function("getData", &Tensor::getData)
+       .function("rank", &Tensor::rank)
+       .function("size", optional_override([](const Tensor &self) { return (double)self.size(); }))
+       .function("isContiguous", &Tensor::isContiguous)
+       .function("get", select_overload<double(emscripten::val) const>(&Tensor::get))
+       .function("set", select_overload<void(emscripten::val, double)>(&Tensor::set))
+       .function("push", select_overload<void(emscripten::val)>(&Tensor::push))
+       .function("insert", select_overload<void(int, emscripten::val)>(&Tensor::insert))
+       .function("pop", &Tensor::pop)
+       .function("slice", select_overload<Tensor(int, int) const>(&Tensor::slice))
+       .function("slice", select_overload<Tensor(int) const>(&Tensor::slice))
+       .function("narrow", &Tensor::narrow)
+       .function("transpose", &Tensor::transpose)
+       .function("permute", optional_override([](const Tensor &self, val axes) {
+                    return self.permute(convertJSArrayToNumberVector<int>(axes));
+                 }))
+       .function("reshape", optional_override([](const Tensor &self, val shape) {
+                    return self.reshape(convertJSArrayToNumberVector<int>(shape));
+                 }))
+       .function("contiguous", &Tensor::contiguous)
+       .function("clone", &Tensor::clone)
+       .function("asMatrix", &Tensor::asMatrix)
+       .function("show", &Tensor::show);
+
+   value_object<CacheStats>("CacheStats")
+       .field("hits", &CacheStats::hits)
+       .field("misses", &CacheStats::misses)
+       .field("entries", &CacheStats::entries);
+
+   value_object<OnlineConfig>("OnlineConfig")
+       .field("capacity", &OnlineConfig::capacity)
+       .field("batchSize", &OnlineConfig::batchSize)
+       .field("userFraction", &OnlineConfig::userFraction);
+
+   value_object<PipelineConfig>("PipelineConfig")
+       .field("batchSize", &PipelineConfig::batchSize)
+       .field("maxInFlight", &PipelineConfig::maxInFlight)
+       .field("stashWeights", &PipelineConfig::stashWeights);
+
+   value_object<AugmentConfig>("AugmentConfig")
+       .field("maxShift", &AugmentConfig::maxShift)
+       .field("maxRotation", &AugmentConfig::maxRotation)
+       .field("maxScale", &AugmentConfig::maxScale)
+       .field("maxShear", &AugmentConfig::maxShear)
+       .field("elasticAlpha", &AugmentConfig::elasticAlpha)
+       .field("minThickness", &AugmentConfig::minThickness)
+       .field("maxThickness", &AugmentConfig::maxThickness);
+
+   // Epoch shuffle order, a pure function of (count, seed, epoch)
+   function("permutation", optional_override([](int count, unsigned int seed, int epoch) {
+               return permutation(count, seed, epoch);
+            }));
 
    class_<NeuralNetwork>("NeuralNetwork")
        .constructor<int, std::vector<int>, int, double>()
+       .constructor<int, std::vector<int>, int, double, unsigned int>()
        .function("feedForward", &NeuralNetwork::feedForward)
        .function("feedForwardArray", &NeuralNetwork::feedForwardArray)
+       .function("predictBatch",
+                 select_overload<std::vector<double>(const std::vector<double> &, int) const>(&NeuralNetwork::predictBatch))
+       .function("predictBatchTensor", select_overload<std::vector<double>(const Tensor &) const>(&NeuralNetwork::predictBatch))
        .function("train", &NeuralNetwork::train)
        .function("trainArray", &NeuralNetwork::trainArray)
-       .function("trainBatch", &NeuralNetwork::trainBatch)
+       .function("trainBatch",
+                 select_overload<void(const std::vector<double> &, const std::vector<double> &, int)>(&NeuralNetwork::trainBatch))
+       .function("trainBatchTensor", select_overload<void(const Tensor &, const Tensor &)>(&NeuralNetwork::trainBatch))
+       .function("trainHogwild", &NeuralNetwork::trainHogwild)
+       .function("trainPipelined", &NeuralNetwork::trainPipelined)
+       .function("setInferenceCache", &NeuralNetwork::setInferenceCache)
+       .function("clearInferenceCache", &NeuralNetwork::clearInferenceCache)
+       .function("getInferenceCacheStats", &NeuralNetwork::getInferenceCacheStats)
+       .function("getWeightsVersion",
+                 optional_override([](const NeuralNetwork &self) { return (double)self.getWeightsVersion(); }))
+       .function("setAugmentation", &NeuralNetwork::setAugmentation)
+       .function("clearAugmentation", &NeuralNetwork::clearAugmentation)
+       .function("prune", &NeuralNetwork::prune)
+       .function("clearPruneMask", &NeuralNetwork::clearPruneMask)
+       .function("getSparsity", &NeuralNetwork::getSparsity)
+       .function("reseed", &NeuralNetwork::reseed)
+       .function("getSeed", &NeuralNetwork::getSeed)
        .function("getNumLayers", &NeuralNetwork::getNumLayers)
        .function("getLayer", &NeuralNetwork::getLayer)
        .function("getWeights", &NeuralNetwork::getWeights)
        .function("getBiases", &NeuralNetwork::getBiases)
+       .function("loadModelJson", &NeuralNetwork::loadModelJson)
+       .function("loadModelJsonBytes", optional_override([](NeuralNetwork &self, val jsBytes) {
+                    // One bulk copy of a Uint8Array (e.g. a fetched ArrayBuffer) into the heap
+                    std::vector<uint8_t> bytes = convertJSArrayToNumberVector<uint8_t>(jsBytes);
+                    return self.loadModelJson(std::string(bytes.begin(), bytes.end()));
+                 }))
        .function("setWeights", &NeuralNetwork::setWeights)
        .function("setBiases", &NeuralNetwork::setBiases)
+       .function("checkpointBytes", optional_override([](const NeuralNetwork &self, int epoch, int cursor,
+                                                         unsigned int rngState) {
+                    Checkpoint ckpt;
+                    self.snapshot(ckpt);
+                    ckpt.epoch = epoch;
+                    ckpt.cursor = cursor;
+                    ckpt.rngState = rngState;
+                    std::vector<uint8_t> bytes = ckpt.serialize();
+                    // Copy into a JS-owned Uint8Array; the view dies with bytes
+                    return val::global("Uint8Array").new_(typed_memory_view(bytes.size(), bytes.data()));
+                 }))
+       .function("restoreCheckpoint", optional_override([](NeuralNetwork &self, val jsBytes) {
+                    std::vector<uint8_t> bytes = convertJSArrayToNumberVector<uint8_t>(jsBytes);
+                    Checkpoint ckpt;
+                    if (!Checkpoint::deserialize(bytes.data(), bytes.size(), ckpt) || !self.restore(ckpt)) {
+                       return val::null();
+                    }
+                    val cursor = val::object();
+                    cursor.set("epoch", ckpt.epoch);
+                    cursor.set("cursor", ckpt.cursor);
+                    cursor.set("rngState", ckpt.rngState);
+                    return cursor;
+                 }))
        .function("getNeuronVal", &NeuralNetwork::getNeuronVal)
        .function("getWeightVal", &NeuralNetwork::getWeightVal)
        .function("getLayerSize", &NeuralNetwork::getLayerSize)
        .function("resetActivations", &NeuralNetwork::resetActivations)
        .property("lrnRate", &NeuralNetwork::getLrnRate, &NeuralNetwork::setLrnRate)
        .property("lrStep", &NeuralNetwork::getLrStep, &NeuralNetwork::setLrStep);
+
+   class_<SparseNetwork>("SparseNetwork")
+       .constructor<const NeuralNetwork &>()
+       .function("predictBatch", &SparseNetwork::predictBatch)
+       .function("getNonZeros", &SparseNetwork::getNonZeros)
+       .function("getByteSize", &SparseNetwork::getByteSize)
+       .function("serialize", optional_override([](const SparseNetwork &self) {
+                    std::vector<uint8_t> bytes = self.serialize();
+                    return val::global("Uint8Array").new_(typed_memory_view(bytes.size(), bytes.data()));
+                 }))
+       // Loads a file written by serialize; null if it is truncated or malformed.
+       .class_function("deserialize", optional_override([](val jsBytes) {
+                          std::vector<uint8_t> bytes = convertJSArrayToNumberVector<uint8_t>(jsBytes);
+                          SparseNetwork net;
+                          if (!SparseNetwork::deserialize(bytes.data(), bytes.size(), net)) {
+                             return val::null();
+                          }
+                          return val(std::move(net));
+                       }));
+
+   enum_<LrSchedule>("LrSchedule")
+       .value("Constant", LrSchedule::Constant)
+       .value("Step", LrSchedule::Step)
+       .value("Cosine", LrSchedule::Cosine)
+       .value("Plateau", LrSchedule::Plateau);
+
+   enum_<StopReason>("StopReason")
+       .value("Running", StopReason::Running)
+       .value("TargetReached", StopReason::TargetReached)
+       .value("Plateau", StopReason::Plateau)
+       .value("MaxEpochs", StopReason::MaxEpochs);
+
+   value_object<TrainerConfig>("TrainerConfig")
+       .field("schedule", &TrainerConfig::schedule)
+       .field("batchSize", &TrainerConfig::batchSize)
+       .field("maxEpochs", &TrainerConfig::maxEpochs)
+       .field("validateEvery", &TrainerConfig::validateEvery)
+       .field("targetAccuracy", &TrainerConfig::targetAccuracy)
+       .field("patience", &TrainerConfig::patience)
+       .field("minDelta", &TrainerConfig::minDelta)
+       .field("decay", &TrainerConfig::decay)
+       .field("stepEpochs", &TrainerConfig::stepEpochs)
+       .field("minRate", &TrainerConfig::minRate);
+
+   value_object<Validation>("Validation")
+       .field("epoch", &Validation::epoch)
+       .field("seconds", &Validation::seconds)
+       .field("accuracy", &Validation::accuracy)
+       .field("loss", &Validation::loss)
+       .field("lrnRate", &Validation::lrnRate);
+
+   // The NeuralNetwork passed in must not be deleted before the OnlineLearner.
+   class_<OnlineLearner>("OnlineLearner")
+       .constructor<NeuralNetwork &, const OnlineConfig &, unsigned int>()
+       .function("addSample", &OnlineLearner::addSample)
+       .function("addPool", &OnlineLearner::addPool)
+       .function("addPoolBytes", optional_override([](OnlineLearner &self, val jsBytes) {
+                    std::vector<uint8_t> bytes = convertJSArrayToNumberVector<uint8_t>(jsBytes);
+                    return self.addPoolBytes(bytes.data(), bytes.size());
+                 }))
+       .function("step", &OnlineLearner::step)
+       .function("getBufferCount", &OnlineLearner::getBufferCount)
+       .function("getPoolCount", &OnlineLearner::getPoolCount)
+       .function("getSamplesTrained", &OnlineLearner::getSamplesTrained)
+       .function("clearBuffer", &OnlineLearner::clearBuffer);
+
+   // The NeuralNetwork passed in must not be deleted before the Trainer.
+   class_<Trainer>("Trainer")
+       .constructor<NeuralNetwork &, int, const TrainerConfig &>()
+       .function("setValidation", &Trainer::setValidation)
+       .function("setPosition", &Trainer::setPosition)
+       // Like NeuralNetwork.checkpointBytes/restoreCheckpoint, but the file also carries the
+       // trainer's position, plateau state and elapsed time, so schedules resume where they were.
+       .function("checkpointBytes", optional_override([](const Trainer &self, unsigned int rngState) {
+                    Checkpoint ckpt;
+                    self.snapshot(ckpt);
+                    ckpt.rngState = rngState;
+                    std::vector<uint8_t> bytes = ckpt.serialize();
+                    return val::global("Uint8Array").new_(typed_memory_view(bytes.size(), bytes.data()));
+                 }))
+       .function("restoreCheckpoint", optional_override([](Trainer &self, val jsBytes) {
+                    std::vector<uint8_t> bytes = convertJSArrayToNumberVector<uint8_t>(jsBytes);
+                    Checkpoint ckpt;
+                    if (!Checkpoint::deserialize(bytes.data(), bytes.size(), ckpt) || !self.restore(ckpt)) {
+                       return val::null();
+                    }
+                    val cursor = val::object();
+                    cursor.set("epoch", ckpt.epoch);
+                    cursor.set("cursor", ckpt.cursor);
+                    cursor.set("rngState", ckpt.rngState);
+                    return cursor;
+                 }))
+       .function("trainBatch", &Trainer::trainBatch)
+       .function("validate", &Trainer::validate)
+       .function("getStopReason", &Trainer::getStopReason)
+       .function("getEpoch", &Trainer::getEpoch)
+       .function("getTimeToTarget", &Trainer::getTimeToTarget)
+       .function("getLastValidation", optional_override([](const Trainer &self) {
+                    const std::vector<Validation> &history = self.getHistory();
+                    return history.empty() ? val::null() : val(history.back());
+                 }));
 }
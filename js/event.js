@@ -198,53 +198,15 @@ saveBtn.on("click", () => {
    showToast("Network Saved!");
 });
 
-function loadModel(obj) {
-   const numLayers = nn.getNumLayers();
-
-   for (let i = 0; i < numLayers - 1; i++) {
-      if (obj[`weights${i}`] && obj[`bias${i}`]) {
-         // Load Weights
-         const wData = obj[`weights${i}`];
-         const wRows = wData.length;
-         const wCols = wData[0].length;
-
-         const wVec2d = new wasmModule.vector2d();
-         wData.forEach((row) => {
-            const v = new wasmModule.vector1d();
-            row.forEach((val) => v.push_back(val));
-            wVec2d.push_back(v);
-            v.delete();
-         });
-
-         const wMatrix = new wasmModule.Matrix(wRows, wCols, wVec2d);
-         nn.setWeights(i, wMatrix);
-
-         wMatrix.delete();
-         wVec2d.delete();
-
-         // Load Biases
-         const bData = obj[`bias${i}`];
-         const bRows = bData.length;
-         const bCols = bData[0].length;
-
-         const bVec2d = new wasmModule.vector2d();
-         bData.forEach((row) => {
-            const v = new wasmModule.vector1d();
-            row.forEach((val) => v.push_back(val));
-            bVec2d.push_back(v);
-            v.delete();
-         });
-
-         const bMatrix = new wasmModule.Matrix(bRows, bCols, bVec2d);
-         nn.setBiases(i, bMatrix);
-
-         bMatrix.delete();
-         bVec2d.delete();
-      }
+// text: model.json contents, parsed in C++ straight into the weight matrices
+function loadModel(text) {
+   if (!nn.loadModelJson(text)) {
+      showToast("Error loading JSON");
+      return;
    }
 
    // Also save to local storage so it persists
-   setDataFromLocalStorage("sb-nn-data", obj);
+   localStorage.setItem("sb-nn-data", text);
    showToast("Model Loaded!");
 
    // Redraw
@@ -255,10 +217,10 @@ loadJsonBtn.on("click", () => {
    fetch("model.json")
       .then((res) => {
          if (!res.ok) throw new Error("Failed to fetch model.json");
-         return res.json();
+         return res.text();
       })
-      .then((obj) => {
-         loadModel(obj);
+      .then((text) => {
+         loadModel(text);
       })
       .catch((err) => {
          console.warn(
@@ -275,13 +237,7 @@ loadJsonInput.on("change", (e) => {
 
    const reader = new FileReader();
    reader.onload = (event) => {
-      try {
-         const obj = JSON.parse(event.target.result);
-         loadModel(obj);
-      } catch (err) {
-         console.error(err);
-         showToast("Error loading JSON");
-      }
+      loadModel(event.target.result);
    };
    reader.readAsText(file);
    // Reset input so same file can be selected again
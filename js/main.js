@@ -4,6 +4,13 @@ const numInp = pixel * pixel;
 const numHid0 = 64;
 const numHid1 = 64;
 const numOut = 10;
+// Online learning: each training() call adds the drawing to the engine's replay buffer, then
+// ONLINE_FRAMES animation frames each train mixed batches for at most ONLINE_BUDGET_MS.
+// MNIST_POOL_FILE (written by train.js) supplies the rehearsal samples, if it is served.
+const ONLINE_BUDGET_MS = 4;
+const ONLINE_FRAMES = 30;
+const ONLINE_SEED = 42;
+const MNIST_POOL_FILE = "mnist-pool.bin";
 let pencilSize = pixel / 8;
 
 let _min_ = Math.floor(minSize / 100);
@@ -19,6 +26,8 @@ cssRoot.style.setProperty("--view-h", `${_min_ * 1.1}px`);
 
 const c = new Canvas(pixel, pixel, ID("cvs"));
 let nn;
+let learner;
+let onlineFrames = 0;
 let wasmModule;
 
 createMathModule().then((module) => {
@@ -33,6 +42,33 @@ createMathModule().then((module) => {
    nn = new wasmModule.NeuralNetwork(numInp, hiddenSizes, numOut, 1.0);
    hiddenSizes.delete();
 
+   // Redraws and toggles re-run inference on an unchanged canvas; answer those from a cache
+   // that training and weight loads invalidate.
+   nn.setInferenceCache(64, 256);
+
+   // Matrix kernels tuned for this device on the first visit; later visits reuse the cache.
+   // (v2: caches under the old key were tuned on a blank canvas and are ignored.)
+   const gemmCache = getDataFromLocalStorage("sb-nn-gemm-v2");
+   const gemmTuned = gemmCache && wasmModule.importGemmCache(gemmCache) > 0;
+   wasmModule.setGemmAutotune(!gemmTuned);
+
+   // Tune on a drawn "0" rather than a blank canvas: the first layer skips zero pixels, so on an
+   // all-zero input every candidate skips all of its work and the timings are only loop overhead.
+   if (!gemmTuned) {
+      const strokeInput = new wasmModule.vector1d();
+      for (let y = 0; y < pixel; y++) {
+         for (let x = 0; x < pixel; x++) {
+            const r = Math.hypot((x - pixel / 2) / 0.7, y - pixel / 2);
+            strokeInput.push_back(Math.max(0, 1 - Math.abs(r - pixel * 0.3) / 2));
+         }
+      }
+      const tuneOut = nn.feedForwardArray(strokeInput);
+      tuneOut.delete();
+      strokeInput.delete();
+      wasmModule.setGemmAutotune(false);
+      setDataFromLocalStorage("sb-nn-gemm-v2", wasmModule.exportGemmCache());
+   }
+
    // Initialize with zeros to ensure clean state
    const zeroInput = new wasmModule.vector1d();
    for (let i = 0; i < numInp; i++) zeroInput.push_back(0.0);
@@ -54,25 +90,24 @@ createMathModule().then((module) => {
       if (lrShow) lrShow.innerText = savedLR;
    }
 
-   const savedData = getDataFromLocalStorage("sb-nn-data");
-   if (savedData) {
-      const numLayers = nn.getNumLayers();
-      for (let i = 0; i < numLayers - 1; i++) {
-         if (savedData[`bias${i}`]) {
-            const m = new wasmModule.Matrix(savedData[`bias${i}`]);
-            nn.setBiases(i, m);
-            m.delete();
-         }
-         if (savedData[`weights${i}`]) {
-            const m = new wasmModule.Matrix(savedData[`weights${i}`]);
-            nn.setWeights(i, m);
-            m.delete();
-         }
-      }
+   const savedData = localStorage.getItem("sb-nn-data");
+   if (savedData && nn.loadModelJson(savedData)) {
       console.log("Network restored from auto-save");
    }
    // -----------------------
 
+   learner = new wasmModule.OnlineLearner(
+      nn,
+      { capacity: 256, batchSize: 8, userFraction: 0.5 },
+      ONLINE_SEED
+   );
+   fetch(MNIST_POOL_FILE)
+      .then((res) => (res.ok ? res.arrayBuffer() : null))
+      .then((buf) => {
+         if (buf) console.log(`Rehearsal pool: ${learner.addPoolBytes(new Uint8Array(buf))} MNIST samples`);
+      })
+      .catch(() => console.log("No rehearsal pool; each drawing is trained once"));
+
    let ctxView = null;
    let cvsView = document.getElementById("view-cvs");
 
@@ -221,17 +256,28 @@ function training() {
       const targetVec = new wasmModule.vector1d();
       outAry.forEach((v) => targetVec.push_back(v));
 
-      nn.trainArray(inputVec, targetVec);
+      learner.addSample(inputVec, targetVec);
 
       inputVec.delete();
       targetVec.delete();
 
-      if (window.triggerNNAnimation) window.triggerNNAnimation();
+      if (onlineFrames == 0) requestAnimationFrame(onlineStep);
+      onlineFrames = ONLINE_FRAMES;
 
       console.clear();
    }
 }
 
+// Bounded work per frame: the learner stops before exceeding its time budget.
+function onlineStep() {
+   learner.step(ONLINE_BUDGET_MS);
+   if (--onlineFrames > 0) {
+      requestAnimationFrame(onlineStep);
+   } else if (window.triggerNNAnimation) {
+      window.triggerNNAnimation();
+   }
+}
+
 function clearBoard() {
    c.clrScr();
    c.background(0);
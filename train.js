@@ -1,11 +1,16 @@
 const fs = require("fs");
 const zlib = require("zlib");
 const path = require("path");
+const { Worker } = require("worker_threads");
 const createMathModule = require("./wasmJs/wasm.js");
 
 const IMAGES_BASE = "train-images-idx3-ubyte";
 const LABELS_BASE = "train-labels-idx1-ubyte";
 const OUTPUT_FILE = "model.json";
+const CHECKPOINT_FILE = "checkpoint.bin";
+const POOL_FILE = "mnist-pool.bin"; // Rehearsal samples for online learning in the browser
+const POOL_SIZE = 2000;
+const GEMM_CACHE_FILE = "gemm-tune-wasm.txt"; // Kernel tuning for this machine, written on the first run
 
 // Configuration
 const TARGET_PIXEL = 28;
@@ -15,7 +20,26 @@ const NUM_HID1 = 64;
 const NUM_OUT = 10;
 const LEARNING_RATE = 0.1;
 const BATCH_SIZE = 1; // Train in batches
-const EPOCHS = 3;
+const VALIDATION_COUNT = 10000; // Last images of the set, held out to decide when to stop
+// In-engine training controller: the learning rate follows SCHEDULE (Constant, Step, Cosine
+// or Plateau) and training stops at TARGET_ACCURACY, a validation loss plateau or MAX_EPOCHS.
+const SCHEDULE = "Cosine";
+const MAX_EPOCHS = 10;
+const TARGET_ACCURACY = 0.97;
+const CHECKPOINT_EVERY = 10000; // Samples between checkpoints
+const SEED = 42; // Seeds weight init, shuffles and augmentation; `node train.js --resume` continues from CHECKPOINT_FILE
+
+// Random distortions applied in the engine while staging each batch, so MNIST looks
+// more like canvas drawings (shifted, rotated, thicker strokes). Set to null to disable.
+const AUGMENT = {
+   maxShift: 3.0,
+   maxRotation: 0.26,
+   maxScale: 0.15,
+   maxShear: 0.2,
+   elasticAlpha: 1.5,
+   minThickness: -0.3,
+   maxThickness: 1.0,
+};
 
 function loadFile(baseName) {
    if (fs.existsSync(baseName + ".gz")) {
@@ -98,13 +122,27 @@ async function loadMNIST() {
    return { images, labels };
 }
 
-// Shuffle helper
-function shuffle(images, labels) {
-   for (let i = images.length - 1; i > 0; i--) {
-      const j = Math.floor(Math.random() * (i + 1));
-      [images[i], images[j]] = [images[j], images[i]];
-      [labels[i], labels[j]] = [labels[j], labels[i]];
-   }
+// Writes checkpoints on a worker thread so the training loop never waits for the disk.
+// Writes go to a temp file first and are renamed into place, so a crash keeps the previous one.
+function createCheckpointWriter(file) {
+   const worker = new Worker(
+      `const fs = require("fs");
+      const { parentPort } = require("worker_threads");
+      parentPort.on("message", ({ file, bytes }) => {
+         if (!bytes) return parentPort.close();
+         fs.writeFileSync(file + ".tmp", bytes);
+         fs.renameSync(file + ".tmp", file);
+      });`,
+      { eval: true }
+   );
+   return {
+      // bytes is transferred, not copied
+      write: (bytes) => worker.postMessage({ file, bytes }, [bytes.buffer]),
+      close: () => new Promise((resolve) => {
+         worker.once("exit", resolve);
+         worker.postMessage({ file });
+      }),
+   };
 }
 
 async function main() {
@@ -112,6 +150,12 @@ async function main() {
       const wasmModule = await createMathModule();
       console.log("Wasm module loaded.");
 
+      // Tune matrix kernels for each layer shape on the first run, then reuse the cache.
+      const gemmTuned =
+         fs.existsSync(GEMM_CACHE_FILE) &&
+         wasmModule.importGemmCache(fs.readFileSync(GEMM_CACHE_FILE, "utf8")) > 0;
+      wasmModule.setGemmAutotune(!gemmTuned);
+
       const { images, labels } = await loadMNIST();
 
       // Initialize Neural Network
@@ -123,10 +167,60 @@ async function main() {
          NUM_INP,
          hiddenSizes,
          NUM_OUT,
-         LEARNING_RATE
+         LEARNING_RATE,
+         SEED
       );
       console.log("Neural Network initialized.");
 
+      if (AUGMENT) {
+         nn.setAugmentation(AUGMENT, SEED);
+      }
+
+      const trainCount = images.length - VALIDATION_COUNT;
+      const trainer = new wasmModule.Trainer(nn, trainCount, {
+         schedule: wasmModule.LrSchedule[SCHEDULE],
+         batchSize: BATCH_SIZE,
+         maxEpochs: MAX_EPOCHS,
+         validateEvery: CHECKPOINT_EVERY,
+         targetAccuracy: TARGET_ACCURACY,
+         patience: 3,
+         minDelta: 1e-4,
+         decay: 0.5,
+         stepEpochs: 1,
+         minRate: 1e-3,
+      });
+
+      // The checkpoint holds the trainer state too, so the schedule, patience and timer carry on
+      let startEpoch = 0;
+      let startCursor = 0;
+      let seed = SEED;
+      if (process.argv.includes("--resume") && fs.existsSync(CHECKPOINT_FILE)) {
+         const saved = trainer.restoreCheckpoint(new Uint8Array(fs.readFileSync(CHECKPOINT_FILE)));
+         if (!saved) {
+            throw new Error(`${CHECKPOINT_FILE} is corrupt or from a different network shape`);
+         }
+         startEpoch = saved.epoch;
+         startCursor = saved.cursor;
+         seed = saved.rngState;
+         console.log(`Resuming from epoch ${startEpoch + 1}, image ${startCursor}`);
+      }
+      const checkpoints = createCheckpointWriter(CHECKPOINT_FILE);
+      {
+         const valInputs = new wasmModule.vector1d();
+         const valTargets = new wasmModule.vector1d();
+         valInputs.resize(VALIDATION_COUNT * NUM_INP, 0);
+         valTargets.resize(VALIDATION_COUNT * NUM_OUT, 0);
+         for (let j = 0; j < VALIDATION_COUNT; j++) {
+            const img = images[trainCount + j];
+            const lbl = labels[trainCount + j];
+            for (let k = 0; k < NUM_INP; k++) valInputs.set(j * NUM_INP + k, img[k]);
+            for (let k = 0; k < NUM_OUT; k++) valTargets.set(j * NUM_OUT + k, lbl[k]);
+         }
+         trainer.setValidation(valInputs, valTargets, VALIDATION_COUNT);
+         valInputs.delete();
+         valTargets.delete();
+      }
+
       // Pre-allocate vectors for batch training to avoid GC overhead
       const inputsVec = new wasmModule.vector1d();
       const targetsVec = new wasmModule.vector1d();
@@ -136,20 +230,27 @@ async function main() {
       targetsVec.resize(BATCH_SIZE * NUM_OUT, 0);
 
       // Training Loop
-      console.log(`Starting training for ${EPOCHS} epochs...`);
+      console.log(`Training for up to ${MAX_EPOCHS} epochs (${SCHEDULE} schedule, target ${TARGET_ACCURACY * 100}%)...`);
 
-      for (let epoch = 0; epoch < EPOCHS; epoch++) {
-         console.log(`Epoch ${epoch + 1}/${EPOCHS}`);
+      let running = true;
+      let reported = null;
+      for (let epoch = startEpoch; running; epoch++) {
+         console.log(`Epoch ${epoch + 1}/${MAX_EPOCHS}`);
 
-         // Shuffle data each epoch
-         shuffle(images, labels);
+         // Shuffle data each epoch; the order depends only on (seed, epoch), so a resumed run replays it
+         const orderVec = wasmModule.permutation(trainCount, seed, epoch);
+         const order = new Array(trainCount);
+         for (let j = 0; j < trainCount; j++) order[j] = orderVec.get(j);
+         orderVec.delete();
 
-         for (let i = 0; i < images.length; i += BATCH_SIZE) {
-            const currentBatchSize = Math.min(BATCH_SIZE, images.length - i);
+         const first = epoch === startEpoch ? startCursor : 0;
+         let done = first;
+         for (let i = first; i < trainCount && running; i += BATCH_SIZE) {
+            const currentBatchSize = Math.min(BATCH_SIZE, trainCount - i);
 
             // Fill the pre-allocated vectors
             for (let j = 0; j < currentBatchSize; j++) {
-               const idx = i + j;
+               const idx = order[i + j];
                const img = images[idx];
                const lbl = labels[idx];
 
@@ -162,15 +263,51 @@ async function main() {
                }
             }
 
-            nn.trainBatch(inputsVec, targetsVec, currentBatchSize);
+            running = trainer.trainBatch(inputsVec, targetsVec, currentBatchSize);
+
+            done = i + currentBatchSize;
+            if (done % CHECKPOINT_EVERY < currentBatchSize && done < trainCount) {
+               checkpoints.write(trainer.checkpointBytes(seed));
+            }
+
+            const v = trainer.getLastValidation();
+            if (v && (!reported || v.epoch !== reported.epoch)) {
+               reported = v;
+               console.log(
+                  `\nValidation: accuracy ${(v.accuracy * 100).toFixed(2)}%, loss ${v.loss.toFixed(4)}, ` +
+                     `rate ${v.lrnRate.toFixed(4)}, ${v.seconds.toFixed(1)}s`
+               );
+            }
 
             if ((i + currentBatchSize) % 1000 === 0) {
                process.stdout.write(
-                  `\rProcessed ${i + currentBatchSize}/${images.length} images`
+                  `\rProcessed ${i + currentBatchSize}/${trainCount} images`
                );
             }
          }
-         console.log("\nEpoch complete.");
+         if (done < trainCount) {
+            // The trainer stopped mid-epoch (target reached or plateau); --resume continues from here
+            console.log(`\nStopped at image ${done}/${trainCount} of epoch ${epoch + 1}.`);
+         } else {
+            console.log("\nEpoch complete.");
+         }
+         checkpoints.write(trainer.checkpointBytes(seed));
+      }
+
+      const reason = trainer.getStopReason();
+      if (reason === wasmModule.StopReason.TargetReached) {
+         console.log(`Reached ${TARGET_ACCURACY * 100}% in ${trainer.getTimeToTarget().toFixed(1)}s`);
+      } else if (reason === wasmModule.StopReason.Plateau) {
+         console.log("Stopped: validation loss plateaued");
+      } else {
+         console.log(`Stopped after ${MAX_EPOCHS} epochs`);
+      }
+      trainer.delete();
+      await checkpoints.close();
+
+      if (!gemmTuned) {
+         fs.writeFileSync(GEMM_CACHE_FILE, wasmModule.exportGemmCache());
+         console.log(`Kernel tuning (${wasmModule.gemmTarget()}) saved to ${GEMM_CACHE_FILE}`);
       }
 
       inputsVec.delete();
@@ -203,6 +340,19 @@ async function main() {
 
       fs.writeFileSync(OUTPUT_FILE, JSON.stringify(obj));
       console.log(`Model saved to ${OUTPUT_FILE}`);
+
+      // Evenly spaced training images as 784 pixel bytes plus a label byte each
+      const poolCount = Math.min(POOL_SIZE, trainCount);
+      const record = NUM_INP + 1;
+      const pool = Buffer.alloc(poolCount * record);
+      for (let i = 0; i < poolCount; i++) {
+         const idx = Math.floor((i * trainCount) / poolCount);
+         const img = images[idx];
+         for (let k = 0; k < NUM_INP; k++) pool[i * record + k] = Math.round(img[k] * 255);
+         pool[i * record + NUM_INP] = labels[idx].indexOf(1);
+      }
+      fs.writeFileSync(POOL_FILE, pool);
+      console.log(`Rehearsal pool (${poolCount} samples) saved to ${POOL_FILE}`);
    } catch (err) {
       console.error("Error:", err);
    }